@@ -5,6 +5,7 @@
 #include "stdafx.h"
 #include "CrowdAnomalies.h"
 #include "Descriptors2D.h"
+#include "Benchmark.h"
 
 
 /*
@@ -60,6 +61,15 @@ int main(int argc, char ** argv)
 		cr.Execute();
 		break;
 		}
+	case 3:
+		{
+		//Base2 --bench file.yml: synthetic micro benchmark, see Benchmark.h
+		if (string(argv[1]) == "--bench"){
+			Benchmark bench(argv[2]);
+			bench.Execute();
+			break;
+		}
+		}//any other pair of arguments falls through
 	default:
 		{
       cout << "Nothing to do";
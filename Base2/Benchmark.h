@@ -0,0 +1,412 @@
+#pragma once
+
+#include <chrono>
+#include <cfloat>
+#include "CrowdAnomalies.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//Micro benchmark of the descriptors, the OFCM stages, the matchers and the
+//optical flow backends on synthetic data, to catch regressions before a
+//deploy. Everything is read from a yml file:
+//	bench_width, bench_height		frame size (320 x 240)
+//	bench_frames					frames of a window (8)
+//	bench_cuboid_width/height		cuboid size and grid step (16 x 16)
+//	bench_moving					fraction of moving flow pixels (0.3)
+//	bench_train, bench_test			histograms of the matchers (500, 200)
+//	bench_bins						bins of those histograms (32)
+//	bench_repeats, bench_seed		timed runs per case (5), rng seed (1)
+//	bench_output					.csv or .json report, stdout csv if absent
+//the descriptors take their descriptor_* keys from the same file (they are
+//skipped without descriptor_orientNumBin) and OFCM its usual keys
+//(nBinsMagnitude, nBinsAngle, ...). Every case is run once to warm up and then
+//bench_repeats times; the best time gives the throughput
+class Benchmark
+{
+	struct Result
+	{
+		string	group,
+				name,
+				unit;
+		double	items,			//items processed by one run
+				best,			//seconds
+				mean;
+	};
+	typedef std::pair< Mat_<float>, Mat_<float> >	FlowFrame;
+
+	FileStorage		_fs;
+	string			_file,
+					_output;
+	int				_width		= 320,
+					_height		= 240,
+					_frames		= 8,
+					_cuboidW	= 16,
+					_cuboidH	= 16,
+					_train		= 500,
+					_test		= 200,
+					_bins		= 32,
+					_repeats	= 5,
+					_seed		= 1;
+	float			_moving		= 0.3f;
+	RNG				_rng;
+	vector<Result>	_results;
+
+	template <class F>
+	void	Time			( const string &, const string &, const string &, double, F );
+
+	void	SyntheticFrames	( vector<Mat> & );
+
+	void	SyntheticFlow	( vector<FlowFrame> &, float, float );
+
+	void	BenchDescriptors();
+
+	void	BenchOFCM		();
+
+	void	BenchMatchers	();
+
+	void	BenchFlow		();
+
+	void	Report			();
+
+public:
+	Benchmark(string file);
+	void Execute();
+};
+
+////////////////////////////////////////////////////////////////////////////////
+Benchmark::Benchmark(string file){
+	_file	= file;
+	_fs		= FileStorage(file, FileStorage::READ);
+	auto opt = [&](const char * key, int & var){
+		if (!_fs[key].empty()) _fs[key] >> var;
+	};
+	opt("bench_width",			_width);
+	opt("bench_height",			_height);
+	opt("bench_frames",			_frames);
+	opt("bench_cuboid_width",	_cuboidW);
+	opt("bench_cuboid_height",	_cuboidH);
+	opt("bench_train",			_train);
+	opt("bench_test",			_test);
+	opt("bench_bins",			_bins);
+	opt("bench_repeats",		_repeats);
+	opt("bench_seed",			_seed);
+	if (!_fs["bench_moving"].empty())
+		_fs["bench_moving"] >> _moving;
+	if (!_fs["bench_output"].empty())
+		_fs["bench_output"] >> _output;
+	if (_repeats < 1) _repeats = 1;
+	if (_frames < 2) _frames = 2;
+}
+//______________________________________________________________________________
+void Benchmark::Execute(){
+	BenchDescriptors();
+	BenchOFCM();
+	BenchMatchers();
+	BenchFlow();
+	Report();
+}
+//______________________________________________________________________________
+//warm up run, then the timed ones...............................................
+template <class F>
+void Benchmark::Time(const string & group, const string & name, const string & unit,
+					 double items, F f){
+	f();
+	double	best	= DBL_MAX,
+			total	= 0;
+	for (int r = 0; r < _repeats; ++r){
+		auto	start	= chrono::steady_clock::now();
+		f();
+		double	secs	= chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		if (secs < best) best = secs;
+		total += secs;
+	}
+	_results.push_back({ group, name, unit, items, best, total / _repeats });
+	cout << group << " " << name << ": " << items / best << " " << unit << endl;
+}
+//______________________________________________________________________________
+//smooth random texture translated 2 px right and 1 px down per frame, so every
+//backend has texture to track and a known motion
+void Benchmark::SyntheticFrames(vector<Mat> & frames){
+	Mat		texture(_height + _frames, _width + 2 * _frames, CV_8UC3);
+	_rng.fill(texture, RNG::UNIFORM, Scalar::all(0), Scalar::all(256));
+	GaussianBlur(texture, texture, Size(5, 5), 1.5);
+	frames.clear();
+	for (int f = 0; f < _frames; ++f)
+		frames.push_back(texture(Rect(2 * (_frames - f), _frames - f, _width, _height)).clone());
+}
+//______________________________________________________________________________
+//orientation uniform in [0, 360), a _moving fraction of the pixels with a
+//magnitude in (thr, maxMagnitude] and the rest still
+void Benchmark::SyntheticFlow(vector<FlowFrame> & flow, float thr, float maxMagnitude){
+	flow.clear();
+	for (int f = 0; f < _frames; ++f){
+		FlowFrame	fr(Mat_<float>(_height, _width), Mat_<float>(_height, _width));
+		_rng.fill(fr.first, RNG::UNIFORM, 0, 360);
+		for (int i = 0; i < _height; ++i){
+			float *mag = fr.second[i];
+			for (int j = 0; j < _width; ++j)
+				mag[j] = _rng.uniform(0.f, 1.f) < _moving ?
+						 _rng.uniform(thr, maxMagnitude) + FLT_EPSILON : 0.f;
+		}
+		flow.push_back(fr);
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+//every descriptor type on one window of _frames flow frames and the full grid
+void Benchmark::BenchDescriptors(){
+	if (_fs["descriptor_orientNumBin"].empty()){
+		cout << "descriptors skipped, no descriptor_* keys in " << _file << endl;
+		return;
+	}
+	float	thr, maxMagnitude;
+	int		gaborNumBin = 4;
+	_fs["descriptor_thrMagnitude"] >> thr;
+	_fs["descriptor_maxMagnitude"] >> maxMagnitude;
+	if (!_fs["descriptor_gaborNumBin"].empty())
+		_fs["descriptor_gaborNumBin"] >> gaborNumBin;
+	_rng = RNG(_seed);
+
+	vector<FlowFrame>			flow;
+	SyntheticFlow(flow, thr, maxMagnitude);
+	vector<cutil_grig_point>	grid = grid_generator(_height, _width, _cuboidW, _cuboidH,
+													  _cuboidW, _cuboidH);
+	HistogramSink				out;
+	double						cuboids = (double)grid.size();
+
+	//orientation and magnitude: MO, EntropyMO, Hoof
+	Trait_OM::DesInData	inOM(flow, grid);
+	const char	*namesOM[] = { "", "MO", "", "", "EntropyMO", "Hoof" };
+	for (short type : { 1, 4, 5 }){
+		OFDescriptor<Trait_OM> * descrip = selectChildDes<Trait_OM>(type, _file);
+		if (!descrip) continue;
+		Time("descriptor", namesOM[type], "cuboids/s", cuboids, [&]{
+			out.clear();
+			descrip->Describe(inOM, out);
+		});
+		delete descrip;
+	}
+
+	//magnitude only
+	Trait_M::DesInData	inM;
+	for (auto & fr : flow)
+		inM.first.push_back(fr.second);
+	inM.second = grid;
+	if (OFDescriptor<Trait_M> * descrip = selectChildDes<Trait_M>(3, _file)){
+		Time("descriptor", "Magnitude", "cuboids/s", cuboids, [&]{
+			out.clear();
+			descrip->Describe(inM, out);
+		});
+		delete descrip;
+	}
+
+	//flow plus the response of every gabor scale
+	Trait_Gabor::DesInData	inGabor;
+	for (auto & fr : flow){
+		Trait_Gabor::VecMat	vec{ fr.first, fr.second };
+		for (int s = 0; s < gaborNumBin; ++s){
+			Mat_<float>	scale(_height, _width);
+			_rng.fill(scale, RNG::UNIFORM, 0, 1);
+			vec.push_back(scale);
+		}
+		inGabor.first.push_back(vec);
+	}
+	inGabor.second = grid;
+	if (OFDescriptor<Trait_Gabor> * descrip = selectChildDes<Trait_Gabor>(2, _file)){
+		Time("descriptor", "Gabor", "cuboids/s", cuboids, [&]{
+			out.clear();
+			descrip->Describe(inGabor, out);
+		});
+		delete descrip;
+	}
+
+	//flow plus the argmax gabor scale of each pixel
+	Trait_GaborMap::DesInData	inMap;
+	for (auto & fr : flow){
+		Mat_<uchar>	argmax(_height, _width);
+		_rng.fill(argmax, RNG::UNIFORM, 0, gaborNumBin);
+		inMap.first.push_back(Trait_GaborMap::FrameType(fr, argmax));
+	}
+	inMap.second = grid;
+	if (OFDescriptor<Trait_GaborMap> * descrip = selectChildDes<Trait_GaborMap>(6, _file)){
+		Time("descriptor", "GaborMap", "cuboids/s", cuboids, [&]{
+			out.clear();
+			descrip->Describe(inMap, out);
+		});
+		delete descrip;
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+//OFCM split in its stages: the optical flows of setData, the co-occurrence
+//matrices, the Haralick features and the whole description of the cuboids
+void Benchmark::BenchOFCM(){
+	int		nBinsMagnitude		= 4,
+			nBinsAngle			= 8,
+			distanceMagnitude	= 1,
+			distanceAngle		= 1,
+			cuboidLength		= _frames,
+			maxMagnitude		= 15,
+			logQuantization		= 1,
+			movementFilter		= 1,
+			temporalScales		= 1;
+	auto opt = [&](const char * key, int & var){
+		if (!_fs[key].empty()) _fs[key] >> var;
+	};
+	opt("nBinsMagnitude",		nBinsMagnitude);
+	opt("nBinsAngle",			nBinsAngle);
+	opt("distanceMagnitude",	distanceMagnitude);
+	opt("distanceAngle",		distanceAngle);
+	opt("cuboidLength",			cuboidLength);
+	opt("maxMagnitude",			maxMagnitude);
+	opt("logQuantization",		logQuantization);
+	opt("movementFilter",		movementFilter);
+	opt("temporalScales",		temporalScales);
+	if (cuboidLength > _frames) cuboidLength = _frames;
+	_rng = RNG(_seed);
+
+	vector<Mat>		frames,
+					grays;
+	SyntheticFrames(frames);
+	for (auto & fr : frames){
+		Mat	gray;
+		cvtColor(fr, gray, CV_BGR2GRAY);
+		grays.push_back(gray);
+	}
+	vector<int>		scales{ temporalScales };
+	//OFCM cuboids run x0 along the rows and y0 along the columns
+	vector<Cube>	cuboids;
+	for (int x = 0; x + _cuboidH <= _height; x += _cuboidH)
+		for (int y = 0; y + _cuboidW <= _width; y += _cuboidW)
+			for (int t = 0; t + cuboidLength <= _frames; t += cuboidLength)
+				cuboids.push_back(Cube(x, y, t, _cuboidH, _cuboidW, cuboidLength));
+
+	Time("ofcm", "flow", "frames/s", _frames, [&]{
+		OFCM	desc(nBinsMagnitude, nBinsAngle, distanceMagnitude, distanceAngle, cuboidLength,
+					 (float)maxMagnitude, logQuantization, movementFilter != 0, scales);
+		desc.setData(grays);
+	});
+
+	OFCM	desc(nBinsMagnitude, nBinsAngle, distanceMagnitude, distanceAngle, cuboidLength,
+				 (float)maxMagnitude, logQuantization, movementFilter != 0, scales);
+	desc.setData(grays);
+	Time("ofcm", "describe", "cuboids/s", (double)cuboids.size(), [&]{
+		Mat	output;
+		desc.extractParallel(cuboids, output);
+	});
+
+	//the stages alone on one quantized plane, with the magnitude bins
+	Mat_<int>			plane(_height, _width);
+	_rng.fill(plane, RNG::UNIFORM, 0, nBinsMagnitude);
+	CoOccurrenceGeneral	cooc(nBinsMagnitude, distanceMagnitude);
+	vector<Rect>		patches;
+	for (int x = 0; x + _cuboidW <= _width; x += _cuboidW)
+		for (int y = 0; y + _cuboidH <= _height; y += _cuboidH)
+			patches.push_back(Rect(x, y, _cuboidW, _cuboidH));
+	vector<Mat>			matrices;
+	Time("ofcm", "CoOccurrenceGeneral", "patches/s", (double)patches.size(), [&]{
+		matrices.clear();
+		for (auto & patch : patches)
+			cooc.extractAllMatricesDirections(patch, plane, matrices);
+	});
+	vector<float>		features(Haralick::numOldFeatures * matrices.size());
+	Time("ofcm", "Haralick", "matrices/s", (double)matrices.size(), [&]{
+		Haralick::computeOld(matrices, features.data());
+	});
+}
+////////////////////////////////////////////////////////////////////////////////
+//every supp_* matcher on random histograms with counts in [0, 100): with these
+//thresholds no test histogram matches, so the nearest neighbour loops compare
+//all the pairs
+void Benchmark::BenchMatchers(){
+	_rng = RNG(_seed);
+	Mat		train(_train, _bins, CV_32F),
+			test(_test, _bins, CV_32F);
+	_rng.fill(train, RNG::UNIFORM, 0, 100);
+	_rng.fill(test, RNG::UNIFORM, 0, 100);
+	vector<bool>	out(test.rows);
+	double			pairs = (double)train.rows * test.rows;
+	float			bandwidth = 1;
+	if (!_fs["bench_figtree_bandwidth"].empty())
+		_fs["bench_figtree_bandwidth"] >> bandwidth;
+
+	Time("matcher", "SimpleDistance", "pairs/s", pairs, [&]{
+		supp_SimpleDistance(train, test, out, 0);
+	});
+	Time("matcher", "SimpleDistance_cometoguether", "pairs/s", pairs, [&]{
+		supp_SimpleDistance_cometoguether(train, test, out, 0);
+	});
+	//the covariance of the train set is part of every call
+	Time("matcher", "mahalanobisDistanceFunction", "samples/s", test.rows, [&]{
+		supp_mahalanobisDistanceFunction(train, test, out, 0);
+	});
+	Time("matcher", "ComputeDistaceSamples_Train_Figtree", "pairs/s", pairs, [&]{
+		supp_ComputeDistaceSamples_Train_Figtree(train, test, out, bandwidth);
+	});
+	//the all pairs distance of the train set comes first
+	Time("matcher", "meanThrBasedDistance", "pairs/s",
+		 pairs + (double)train.rows * (train.rows - 1), [&]{
+		supp_meanThrBasedDistance(train, test, out, 0);
+	});
+}
+////////////////////////////////////////////////////////////////////////////////
+//each OpticalFlowBase backend on the synthetic color frames...................
+void Benchmark::BenchFlow(){
+	_rng = RNG(_seed);
+	vector<Mat>		frames;
+	SyntheticFrames(frames);
+	OFvecParMat		out;
+
+	vector< pair<string, OpticalFlowBase *> >	backends{
+		{ "OpticalFlowOCV",			new OpticalFlowOCV },
+		{ "OpticalFlowBorder",		new OpticalFlowBorder },
+		{ "OpticalFlowAugereau",	new OpticalFlowAugereau } };
+	for (auto & backend : backends){
+		Time("flow", backend.first, "frames/s", _frames - 1, [&]{
+			out.clear();
+			backend.second->compute(frames, out);
+		});
+		delete backend.second;
+	}
+	//points to track of the frame differences, all the moving pixels
+	OFdataType			diffs;
+	vector<Point2f>		points;
+	MovingPoints		sampler;
+	supp_frame_diffs(frames, diffs);
+	Time("flow", "MovingPoints", "pixels/s", (double)diffs.size() * _width * _height, [&]{
+		for (auto & diff : diffs)
+			sampler.extract(diff, points);
+	});
+}
+////////////////////////////////////////////////////////////////////////////////
+//csv (default) or json by the extension of bench_output.........................
+void Benchmark::Report(){
+	bool			json = _output.size() > 5 &&
+						   _output.compare(_output.size() - 5, 5, ".json") == 0;
+	ofstream		file;
+	if (_output.size())
+		file.open(_output);
+	ostream &		os = _output.size() ? file : cout;
+	if (!os){
+		cout << "cannot write " << _output << endl;
+		return;
+	}
+	os.precision(9);
+	if (json){
+		os << "{\"width\": " << _width << ", \"height\": " << _height
+		   << ", \"frames\": " << _frames << ", \"repeats\": " << _repeats
+		   << ",\n \"results\": [\n";
+		for (size_t i = 0; i < _results.size(); ++i){
+			auto & r = _results[i];
+			os << "  {\"group\": \"" << r.group << "\", \"name\": \"" << r.name
+			   << "\", \"unit\": \"" << r.unit << "\", \"items\": " << r.items
+			   << ", \"best_s\": " << r.best << ", \"mean_s\": " << r.mean
+			   << ", \"throughput\": " << r.items / r.best << "}"
+			   << (i + 1 < _results.size() ? ",\n" : "\n");
+		}
+		os << " ]}\n";
+	}
+	else{
+		os << "group,name,unit,items,best_s,mean_s,throughput\n";
+		for (auto & r : _results)
+			os << r.group << "," << r.name << "," << r.unit << "," << r.items << ","
+			   << r.best << "," << r.mean << "," << r.items / r.best << "\n";
+	}
+}
@@ -310,6 +310,69 @@ static void computeAMmat(cv::Mat_<float> &u, cv::Mat_<float> &v, std::pair<cv::M
   }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//optical flow class for the gcg color optical flow (Augereau et al., CIC05)
+//it works on the three color channels, no moving pixel selection is made
+struct OpticalFlowAugereau : public OpticalFlowBase
+{
+  virtual void	compute(OFdataType & /*in*/, OFvecParMat & /*out*/);
+};
+
+//split a frame into three float signals, same row order as the opencv image
+static void supp_ocvFrame2gcgChannels(cv::Mat &frame, gcgDISCRETE2D<float> *channels) {
+  cv::Mat color, samples;
+  std::vector<cv::Mat> planes;
+  if (frame.channels() == 1)
+    cv::cvtColor(frame, color, CV_GRAY2BGR);
+  else
+    color = frame;
+  color.convertTo(samples, CV_32F);
+  cv::split(samples, planes);
+  for (int c = 0; c < 3; ++c) {
+    channels[c].createSignal(frame.cols, frame.rows, 0, 0);
+    cv::Mat dst(frame.rows, frame.cols, CV_32FC1, channels[c].data);
+    planes[c].copyTo(dst);
+  }
+}
+
+void OpticalFlowAugereau::compute(OFdataType & in, OFvecParMat & out)
+{
+  assert(in.size()>1);
+  //three frames are kept: the sequence derivative caches the low pass of the
+  //last frame by its address, so the slot of a new frame must differ from both
+  gcgDISCRETE2D<float>          frames[3][3],
+                                dx[3],
+                                dy[3],
+                                dt[3],
+                                u,
+                                v;
+  gcgSEQUENCEDERIVATIVE2D<float>  sequence[3];
+  //.......................................................
+  supp_ocvFrame2gcgChannels(in[0], frames[0]);
+  for (size_t i = 0; i < in.size() - 1; ++i){
+    gcgDISCRETE2D<float> *current = frames[i % 3],
+                         *next    = frames[(i + 1) % 3];
+    supp_ocvFrame2gcgChannels(in[i + 1], next);
+    for (int c = 0; c < 3; ++c) {
+      gcgGradientSobel2D(&current[c], &dx[c], &dy[c]);
+      sequence[c].sequenceDerivative(&current[c], &next[c], &dt[c]);
+    }
+    gcgOpticalFlowAugereau2D(&dx[0], &dy[0], &dt[0], &dx[1], &dy[1], &dt[1],
+                             &dx[2], &dy[2], &dt[2], &u, &v);
+
+    //wrapping the flow, no copies
+    cv::Mat_<float> flowu(u.height, u.width, u.data);
+    cv::Mat_<float> flowv(v.height, v.width, v.data);
+    OFparMat data;
+    data.first  = cv::Mat_<float>(u.height, u.width);
+    data.second = cv::Mat_<float>(u.height, u.width);
+    computeAMmat(flowu, flowv, data);
+    out.push_back(data);
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void computeOfMarcelo(string src, string file_ext, string out_directory) {
 
@@ -12,6 +12,14 @@
 #include <string.h>
 #include <windows.h>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 //-----------------Definciones-----------------------------------------------
 //----------------------------------------------------------------------------
@@ -24,6 +32,7 @@ typedef unsigned int	uint;
 
 #define _PI 3.14159265359
 bool	cmpStrNum(const std::string &a, const std::string &b);
+bool	cutil_natural_less(const std::string &a, const std::string &b);
 
 
 ///////////////////////////FUNCIONES//////////////////////////////////////////
@@ -57,6 +66,34 @@ bool cmpStrNum(const std::string &a, const std::string &b)
 	if (a.size() < b.size())return true;
 	return false;
 }
+//-----------------------------------------------------------------------------
+//natural order: digit runs compare by value (frame_2 before frame_10), the
+//rest char by char; equal values with other zero padding use plain order
+bool cutil_natural_less(const std::string &a, const std::string &b)
+{
+	size_t i = 0, j = 0;
+	while (i < a.size() && j < b.size()){
+		if (isdigit((unsigned char)a[i]) && isdigit((unsigned char)b[j])){
+			size_t ei = i, ej = j;
+			while (ei < a.size() && isdigit((unsigned char)a[ei])) ei++;
+			while (ej < b.size() && isdigit((unsigned char)b[ej])) ej++;
+			while (i + 1 < ei && a[i] == '0') i++;
+			while (j + 1 < ej && b[j] == '0') j++;
+			if (ei - i != ej - j) return ei - i < ej - j;
+			int c = a.compare(i, ei - i, b, j, ej - j);
+			if (c) return c < 0;
+			i = ei;
+			j = ej;
+		}
+		else{
+			if (a[i] != b[j]) return (unsigned char)a[i] < (unsigned char)b[j];
+			i++;
+			j++;
+		}
+	}
+	if (i == a.size() && j == b.size()) return a < b;
+	return i == a.size();
+}
 //---------------------------------------------------------------------------
 //mostrar cutil_file_contenido de un puntero 
 template <class t>
@@ -165,58 +202,6 @@ void list_files(cutil_file_cont & sal, const char *d, const char * token)
 	else
 		perror("");
 }
-//Lista todos los archivos token de una carpeta y subcarpetas
-void list_files_all(cutil_file_cont & sal, const char *d, const char * token)
-{
-	DIR		*dir;
-	struct	dirent *ent;
-	std::string  path(d);
-	path += "/";
-	if ((dir = opendir(d)) != NULL) {
-		while ((ent = readdir(dir)) != NULL)
-		{
-			std::string fil = ent->d_name;
-			if (fil.find(token) + 1)
-			{
-				sal.push_back(path + ent->d_name);
-			}
-			else
-			{
-				if ((int)fil.find(".")<0)
-					list_files_all(sal, std::string(path + ent->d_name).c_str(), token);
-			}
-		}
-		closedir(dir);
-	}
-	else
-		perror("");
-}
-//Lista todos los archivos token de una carpeta y subcarpetas ademas lista subcarpetas
-void list_files_all(cutil_file_cont & sala, cutil_file_cont & salc, const char *d, const char * token)
-{
-	DIR		*dir;
-	struct	dirent *ent;
-	std::string  path(d);
-	path += "/";
-	if ((dir = opendir(d)) != NULL) {
-		while ((ent = readdir(dir)) != NULL)
-		{
-			std::string fil = ent->d_name;
-			if (fil.find(token) + 1){
-				sala.push_back(path + ent->d_name);
-			}
-			else{
-				if ((int)fil.find(".") < 0){
-					salc.push_back(path + ent->d_name);
-					list_files_all(sala, salc, std::string(path + ent->d_name).c_str(), token);
-				}
-			}
-		}
-		closedir(dir);
-	}
-	else
-		perror("");
-}
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 //______________________________________________________________________________
@@ -238,9 +223,15 @@ struct DirectoryNode{
 		_father(father){}
 	DirectoryNode(std::string label) :
 		_label(label){}
+	//releases the sons, the node itself stays valid and empty
 	void Destroy()
 	{
-
+		for (auto son : _sons){
+			son->Destroy();
+			delete son;
+		}
+		_sons.clear();
+		_listFile.clear();
 	}
 };
 std::ostream & operator << (std::ostream & os, DirectoryNode node)
@@ -250,31 +241,284 @@ std::ostream & operator << (std::ostream & os, DirectoryNode node)
 }
 //______________________________________________________________________________
 ////////////////////////////////////////////////////////////////////////////////
-//this version of list files returns in the intial node the files with determi-.
-//mate token that existing into the root node directory, if some directory con-.
-//tains some target file then the flag is turned to true........................
-void list_files_all_tree(DirectoryNode * node, const char * token)
+//Directory scanner: entries are classified by their real type (d_type, or stat
+//when the platform leaves it unknown), directories are read by a pool of threads
+//and files and sons are sorted, in natural order by default. The tree can be
+//kept in a manifest file that is reused while none of its directories changed
+struct cutil_scan_options{
+	int			_numThreads = 0;	//directories read at once, 0: one per core
+	bool		_natural = true;	//natural order of files and sons, else plain
+	std::string	_manifest;			//manifest file to reuse and store, empty: none
+};
+//______________________________________________________________________________
+static int cutil_scan_threads(int numThreads)
+{
+	if (numThreads <= 0)
+		numThreads = (int)std::thread::hardware_concurrency();
+	return numThreads < 1 ? 1 : numThreads;
+}
+//______________________________________________________________________________
+//DT_DIR / DT_REG of an entry, 0 for anything else or when it cannot be resolved
+static int cutil_entry_type(const std::string & path, const struct dirent * ent)
+{
+	if (ent->d_type == DT_DIR || ent->d_type == DT_REG)
+		return ent->d_type;
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return 0;
+	if (S_ISDIR(st.st_mode)) return DT_DIR;
+	if (S_ISREG(st.st_mode)) return DT_REG;
+	return 0;
+}
+//______________________________________________________________________________
+//modification time of every path, -1 when it does not exist anymore............
+static void cutil_stat_mtimes(const std::vector<std::string> & paths, int numThreads,
+							  std::vector<long long> & mtimes)
+{
+	mtimes.assign(paths.size(), -1);
+	std::atomic<size_t>	next(0);
+	auto worker = [&](){
+		for (size_t i = next++; i < paths.size(); i = next++){
+			struct stat st;
+			if (stat(paths[i].c_str(), &st) == 0)
+				mtimes[i] = (long long)st.st_mtime;
+		}
+	};
+	numThreads = cutil_scan_threads(numThreads);
+	if (numThreads > (int)paths.size())
+		numThreads = (int)paths.size();
+	std::vector<std::thread> threads;
+	for (int t = 1; t < numThreads; t++)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (auto & th : threads)
+		th.join();
+}
+//______________________________________________________________________________
+//reads one directory: regular files whose name contains the token go to the node
+//list and directories become sons, both sorted so the result does not depend on
+//the order in which the file system returns them
+static void cutil_scan_node(DirectoryNode * node, const std::string & token, bool natural)
 {
 	DIR		*dir;
 	struct	dirent *ent;
 	std::string  path = node->_label + "/";
-	if ((dir = opendir(node->_label.c_str())) != NULL) {
-		while ((ent = readdir(dir)) != NULL){
-			std::string fil = ent->d_name;
-			if (fil.find(token) + 1)
-				node->_listFile.push_back(path + ent->d_name);
-			else{
-				if ((int)fil.find(".") < 0){
-					DirectoryNode * file = new DirectoryNode(path + ent->d_name, node);
-					node->_sons.push_back(file);
-					list_files_all_tree(*(node->_sons.end() - 1), token);
-				}
-			}
+	std::vector<std::string> sons;
+	if ((dir = opendir(node->_label.c_str())) == NULL){
+		perror(node->_label.c_str());
+		return;
+	}
+	while ((ent = readdir(dir)) != NULL){
+		std::string fil = ent->d_name;
+		if (fil == "." || fil == "..")
+			continue;
+		int type = cutil_entry_type(path + fil, ent);
+		if (type == DT_DIR)
+			sons.push_back(path + fil);
+		else if (type == DT_REG && fil.find(token) != std::string::npos)
+			node->_listFile.push_back(path + fil);
+	}
+	closedir(dir);
+	if (natural){
+		std::sort(node->_listFile.begin(), node->_listFile.end(), cutil_natural_less);
+		std::sort(sons.begin(), sons.end(), cutil_natural_less);
+	}
+	else{
+		std::sort(node->_listFile.begin(), node->_listFile.end());
+		std::sort(sons.begin(), sons.end());
+	}
+	for (auto & son : sons)
+		node->_sons.push_back(new DirectoryNode(son, node));
+}
+//______________________________________________________________________________
+//breadth-first work queue, every worker takes a directory and queues its sons...
+static void cutil_scan_parallel(DirectoryNode * root, const std::string & token,
+								const cutil_scan_options & opt)
+{
+	std::mutex					mtx;
+	std::condition_variable		ready;
+	std::deque<DirectoryNode*>	pending(1, root);
+	int							busy = 0;
+	auto worker = [&](){
+		std::unique_lock<std::mutex> lock(mtx);
+		for (;;){
+			ready.wait(lock, [&]{ return !pending.empty() || busy == 0; });
+			if (pending.empty())
+				break;
+			DirectoryNode * node = pending.front();
+			pending.pop_front();
+			busy++;
+			lock.unlock();
+			cutil_scan_node(node, token, opt._natural);
+			lock.lock();
+			for (auto son : node->_sons)
+				pending.push_back(son);
+			busy--;
+			ready.notify_all();
 		}
-		closedir(dir);
+	};
+	std::vector<std::thread> threads;
+	int numThreads = cutil_scan_threads(opt._numThreads);
+	for (int t = 1; t < numThreads; t++)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (auto & th : threads)
+		th.join();
+}
+//______________________________________________________________________________
+//directories of the tree in pre-order, with the index of their father...........
+static void cutil_tree_preorder(DirectoryNode * node, int father,
+								std::vector<DirectoryNode*> & nodes, std::vector<int> & fathers)
+{
+	int idx = (int)nodes.size();
+	nodes.push_back(node);
+	fathers.push_back(father);
+	for (auto son : node->_sons)
+		cutil_tree_preorder(son, idx, nodes, fathers);
+}
+//______________________________________________________________________________
+//manifest layout: header with root, token and order, then one "D <father>
+//<mtime> <path>" line per directory in pre-order followed by its "F <path>"
+static void cutil_manifest_store(DirectoryNode * root, const std::string & token,
+								 const cutil_scan_options & opt)
+{
+	std::vector<DirectoryNode*>	nodes;
+	std::vector<int>			fathers;
+	std::vector<std::string>	paths;
+	std::vector<long long>		mtimes;
+	cutil_tree_preorder(root, -1, nodes, fathers);
+	for (auto node : nodes)
+		paths.push_back(node->_label);
+	cutil_stat_mtimes(paths, opt._numThreads, mtimes);
+
+	std::string		tmp = opt._manifest + ".tmp";
+	std::ofstream	out(tmp);
+	if (!out){
+		perror(opt._manifest.c_str());
+		return;
+	}
+	out << "cutil_manifest 1\n"
+		<< "root " << root->_label << "\n"
+		<< "token " << token << "\n"
+		<< "order " << (opt._natural ? "natural" : "plain") << "\n";
+	for (size_t i = 0; i < nodes.size(); i++){
+		out << "D " << fathers[i] << " " << mtimes[i] << " " << nodes[i]->_label << "\n";
+		for (auto & file : nodes[i]->_listFile)
+			out << "F " << file << "\n";
+	}
+	out.close();
+	remove(opt._manifest.c_str());
+	if (!out || rename(tmp.c_str(), opt._manifest.c_str()) != 0)
+		remove(tmp.c_str());
+}
+//______________________________________________________________________________
+//loads the manifest into root when it belongs to the same scan and every one of
+//its directories keeps the recorded modification time; false otherwise
+static bool cutil_manifest_load(DirectoryNode * root, const std::string & token,
+								const cutil_scan_options & opt)
+{
+	std::ifstream	in(opt._manifest);
+	std::string		line;
+	if (!in)
+		return false;
+	if (!std::getline(in, line) || line != "cutil_manifest 1") return false;
+	if (!std::getline(in, line) || line != "root " + root->_label) return false;
+	if (!std::getline(in, line) || line != "token " + token) return false;
+	if (!std::getline(in, line) ||
+		line != std::string("order ") + (opt._natural ? "natural" : "plain")) return false;
+
+	std::vector<DirectoryNode*>	nodes;
+	std::vector<std::string>	paths;
+	std::vector<long long>		recorded, mtimes;
+	bool						valid = true;
+	while (valid && std::getline(in, line)){
+		if (line.compare(0, 2, "F ") == 0 && nodes.size()){
+			nodes.back()->_listFile.push_back(line.substr(2));
+			continue;
+		}
+		std::istringstream	ss(line);
+		std::string			tag, path;
+		int					father;
+		long long			mtime;
+		if (!(ss >> tag >> father >> mtime) || tag != "D" ||
+			father >= (int)nodes.size() || (father < 0) != nodes.empty()){
+			valid = false;
+			break;
+		}
+		std::getline(ss >> std::ws, path);
+		DirectoryNode * node = root;
+		if (father >= 0){
+			node = new DirectoryNode(path, nodes[father]);
+			nodes[father]->_sons.push_back(node);
+		}
+		else if (path != root->_label)
+			valid = false;
+		nodes.push_back(node);
+		paths.push_back(path);
+		recorded.push_back(mtime);
+	}
+	if (valid && nodes.size()){
+		cutil_stat_mtimes(paths, opt._numThreads, mtimes);
+		valid = mtimes == recorded;
 	}
 	else
-		perror("");//if someone wants to say something in erro cases XD
+		valid = false;
+	if (!valid)
+		root->Destroy();
+	return valid;
+}
+//______________________________________________________________________________
+//fills node (its label is the directory) with the tree of files that contain
+//the token, from the manifest when it is still valid or by a parallel scan.....
+void cutil_scan_tree(DirectoryNode * node, const char * token,
+					 const cutil_scan_options & opt = cutil_scan_options())
+{
+	if (!opt._manifest.empty() && cutil_manifest_load(node, token, opt))
+		return;
+	cutil_scan_parallel(node, token, opt);
+	if (!opt._manifest.empty())
+		cutil_manifest_store(node, token, opt);
+}
+//______________________________________________________________________________
+//flattened scan, files (and directories when dirs is given) in pre-order are
+//appended to the containers
+static void cutil_tree_flatten(DirectoryNode * node, cutil_file_cont & files, cutil_file_cont * dirs)
+{
+	files.insert(files.end(), node->_listFile.begin(), node->_listFile.end());
+	for (auto son : node->_sons){
+		if (dirs)
+			dirs->push_back(son->_label);
+		cutil_tree_flatten(son, files, dirs);
+	}
+}
+void cutil_scan_files(cutil_file_cont & files, cutil_file_cont * dirs, const char * d,
+					  const char * token, const cutil_scan_options & opt = cutil_scan_options())
+{
+	DirectoryNode	root(d);
+	cutil_scan_tree(&root, token, opt);
+	cutil_tree_flatten(&root, files, dirs);
+	root.Destroy();
+}
+//______________________________________________________________________________
+////////////////////////////////////////////////////////////////////////////////
+//Lista todos los archivos token de una carpeta y subcarpetas
+void list_files_all(cutil_file_cont & sal, const char *d, const char * token)
+{
+	cutil_scan_files(sal, nullptr, d, token);
+}
+//Lista todos los archivos token de una carpeta y subcarpetas ademas lista subcarpetas
+void list_files_all(cutil_file_cont & sala, cutil_file_cont & salc, const char *d, const char * token)
+{
+	cutil_scan_files(sala, &salc, d, token);
+}
+//______________________________________________________________________________
+////////////////////////////////////////////////////////////////////////////////
+//this version of list files returns in the intial node the files with determi-.
+//mate token that existing into the root node directory, if some directory con-.
+//tains some target file then the flag is turned to true........................
+void list_files_all_tree(DirectoryNode * node, const char * token)
+{
+	cutil_scan_tree(node, token);
 }
 
 #endif 
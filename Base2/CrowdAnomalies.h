@@ -9,6 +9,7 @@
 #include <assert.h>
 #include "Support.h"
 #include "CUtil.h"
+#include "Instrumentation.h"
 #include "Descriptor.h"
 #include <queue>
 #include <assert.h>
@@ -25,7 +26,8 @@ using namespace cv;
 
 static const int num_threads = 10;
 void determinePatterns	( Mat & train, Mat & test, vector<bool> & out, float thr, int type);
-void loadImages2Vec		( std::string &, int, std::string &, float,
+void determinePatternsGated	( Mat & train, Mat & test, vector<bool> & out, float thr, int type);
+void loadImages2Vec		( std::string &, int, std::string &, const FramePrep &,
 						  int, std::vector< cv::Mat > &);
 //=================================================================
 //CrowdAnomalies main class of the project.........................
@@ -41,9 +43,16 @@ class CrowdAnomalies
       _main_cuboid_over_height,	//cuboids height overlap
       _main_descriptor_type,
       _main_descriptor_type_extract;
-	double		  _scale;
+  FramePrep	  _prep;		//scale and interpolation of the frames
+  MovingPoints	  _points;		//density of the pixels tracked by the sparse flows
   FileStorage _fs;
   string		  _mainfile;
+  DescriptorCache _cache;		//descriptor outputs of precomputed flow
+  cutil_scan_options _scan;		//directory scanner, threads and order
+  string		  _scan_manifest_dir;	//manifests of the scans, empty: none
+  string		  _instrument_report;	//stage report file, empty: stdout
+  bool		  _gated = false;		//motion gate of the video modes
+  MotionGate	  _gate;
 
 	//MAIN FUNCTIONS....................................................
 	void	Precompute_OF();
@@ -64,17 +73,23 @@ class CrowdAnomalies
 
   void  Feat_Extract_OFCM();
 
+  void  Feat_Extract_OFCM_Stream(cutil_file_cont &, string, short, short, short, short,
+                                 short, short, short, short, vector<int> &);
+
 
 	//SUPPORT FUNCTIONS.................................................
 	void	Feat_Extract_OM();
 
 	void	DescribeSeq		( DirectoryNode &, vector<cutil_grig_point> &, Mat &,
-							  string &, string & );
+							  string &, string &, const ContentHash &, ProgressReport &,
+							  int = 0 );
 
 	void	Feat_Extract_Gabor();
 
 	void	Feat_Extract_Online();
 
+	void	Feat_Extract_Gabor_Stream();
+
   void  RepairPeds2();
   
 	//..................................................................
@@ -86,6 +101,14 @@ class CrowdAnomalies
 
 	void	Graphix			( vector<vector<bool> > & );
 
+	ContentHash	DescriptorKey	( vector<cutil_grig_point> & );
+
+	void	ScanFiles		( cutil_file_cont &, const string &, const string & );
+
+	void	ScanTree		( DirectoryNode *, const string & );
+
+	void	WriteSink		( HistogramSink &, const string & );
+
   
 
 	
@@ -113,8 +136,72 @@ CrowdAnomalies::CrowdAnomalies(string featf){
 	_fs["main_cuboid_over_height"]	      >> _main_cuboid_over_height;
 	_fs["main_descriptor_type"]		        >> _main_descriptor_type;
 	_fs["main_descriptor_type_extract"]		>> _main_descriptor_type_extract;
-	_fs["main_image_scale"]			          >> _scale;
+	_fs["main_image_scale"]			          >> _prep._scale;
+	if (!_fs["main_image_interpolation"].empty()){
+		string	interpolation;
+		_fs["main_image_interpolation"] >> interpolation;
+		_prep._interpolation = FramePrep::interpolation(interpolation);
+	}
+
+	//optional descriptor cache, off when there is no directory
+	if (!_fs["main_descriptor_cache_dir"].empty()){
+		string	dir;
+		double	maxMB = 1024;
+		int		maxEntries = 0;
+		_fs["main_descriptor_cache_dir"] >> dir;
+		if (!_fs["main_descriptor_cache_max_mb"].empty())
+			_fs["main_descriptor_cache_max_mb"] >> maxMB;
+		if (!_fs["main_descriptor_cache_max_entries"].empty())
+			_fs["main_descriptor_cache_max_entries"] >> maxEntries;
+		cutil_create_new_dir_all(dir);
+		_cache.open(dir, maxMB, maxEntries);
+	}
+
+	//directory scanner: threads (0: one per core), natural order and the
+	//optional directory where the manifest of every scanned root is kept
+	if (!_fs["main_scan_threads"].empty())
+		_fs["main_scan_threads"] >> _scan._numThreads;
+	if (!_fs["main_scan_natural_order"].empty()){
+		int natural;
+		_fs["main_scan_natural_order"] >> natural;
+		_scan._natural = natural != 0;
+	}
+	if (!_fs["main_scan_manifest_dir"].empty()){
+		_fs["main_scan_manifest_dir"] >> _scan_manifest_dir;
+		cutil_create_new_dir_all(_scan_manifest_dir);
+	}
 
+	//points tracked by the sparse flows (OpenCV and OFCM): one pixel of every
+	//stride x stride block, at most cell_cap per cell x cell cell (0 all)
+	if (!_fs["main_points_stride"].empty())
+		_fs["main_points_stride"] >> _points.stride;
+	if (!_fs["main_points_cell"].empty())
+		_fs["main_points_cell"] >> _points.cellSize;
+	if (!_fs["main_points_cell_cap"].empty())
+		_fs["main_points_cell_cap"] >> _points.cellCap;
+
+	//motion gate: the still cuboids of a window skip flow and description
+	if (!_fs["main_motion_gate"].empty()){
+		int	on;
+		_fs["main_motion_gate"] >> on;
+		_gated = on != 0;
+		if (!_fs["main_motion_gate_thr"].empty())
+			_fs["main_motion_gate_thr"] >> _gate._thr;
+		if (!_fs["main_motion_gate_min_fraction"].empty())
+			_fs["main_motion_gate_min_fraction"] >> _gate._minFraction;
+		if (!_fs["main_motion_gate_refresh"].empty())
+			_fs["main_motion_gate_refresh"] >> _gate._refresh;
+	}
+
+	//stage timers and counters, reported at the end of Execute
+	if (!_fs["main_instrument"].empty()){
+		int	on;
+		_fs["main_instrument"] >> on;
+		if (!_fs["main_instrument_report"].empty())
+			_fs["main_instrument_report"] >> _instrument_report;
+		if (on)
+			supp_instrument().start();
+	}
 }
 
 //=================================================================
@@ -164,6 +251,8 @@ void CrowdAnomalies::Execute()
 		}
 		default:{}
 	}
+	if (supp_instrument().enabled())
+		supp_instrument().report(_instrument_report);
 }
 //==================================================================
 //Function to precompute the optical flow of some directory to other
@@ -179,6 +268,7 @@ void CrowdAnomalies::Precompute_OF()
           out_directory,
           file_extension;
   int			type,
+          method,
           video_step;
   OFdataType	      image_vector;
   OFvecParMat	      of_out;
@@ -190,34 +280,45 @@ void CrowdAnomalies::Precompute_OF()
   _fs["main_precompute_of_dir"] >> directory;
   _fs["main_precompute_of_ext"] >> file_extension;
   _fs["main_precompute_of_out"] >> out_directory;
+  //the technique used to follow the source type, older files have no method
+  method = type;
+  if (!_fs["main_precompute_of_method"].empty())
+    _fs["main_precompute_of_method"] >> method;
 
   //.............................................................
   //choosing the optical flow technique
-  switch (type){
+  switch (method){
   case 0:
-           oflow = new OpticalFlowOCV; // opencv pyramid of
+           oflow = new OpticalFlowOCV(_points); // opencv pyramid of
            break;
   
   case 1: 
           oflow = new OpticalFlowBorder; // william's friend 
           break;
+
+  case 2:
+          oflow = new OpticalFlowAugereau; // gcg color optical flow
+          break;
   }
 
   //.............................................................
   //loading the images into a vector
-	loadImages2Vec(directory, type, file_extension, _scale, video_step, image_vector);
+	loadImages2Vec(directory, type, file_extension, _prep, video_step, image_vector);
   //computing the optical flow of all images
-	oflow->compute(image_vector, of_out);
+	supp_timed(STAGE_FLOW, [&]{ oflow->compute(image_vector, of_out); });
+	supp_instrument().count(STAGE_FLOW, of_out.size());
   //for two images we have a magnitude and orientation
 	cutil_create_new_dir_all(out_directory);
 	for (size_t i = 0; i < of_out.size(); ++i)
 	{
 		stringstream outfile;
 		outfile << out_directory<< "/opticalflow_" << insert_numbers(i+1, of_out.size()) << "of.yml";
+		InstrumentScope	io(STAGE_IO);
 		FileStorage fs(outfile.str(), FileStorage::WRITE);
 		fs << "angle" << of_out[i].first;
 		fs << "magnitude" << of_out[i].second;
 		fs.release();
+		supp_instrument().writtenFile(STAGE_IO, outfile.str());
 	}
 	delete oflow;
 }
@@ -231,6 +332,7 @@ void CrowdAnomalies::Precompute_OF()
 //ext : file extension....................................................
 //orientation scales : for gabor filter ..................................
 //gaborType : if want the sum or max value for scales....................
+//normApproximate : optional, histogram percentiles to normalize.........
 void CrowdAnomalies::Precompute_Gabor()
 {
 	cout << "Precompute_gabor" << endl;
@@ -240,7 +342,8 @@ void CrowdAnomalies::Precompute_Gabor()
 	int		  orientation,
           scales,
           gaborType,
-          wdsize;
+          wdsize,
+          normApproximate = 0;
 	cutil_file_cont fileList;
 	//...................................................................
 	//loading info
@@ -251,27 +354,37 @@ void CrowdAnomalies::Precompute_Gabor()
 	_fs["main_precompute_gabor_scales"]			>> scales;
 	_fs["main_precompute_gabor_type"]			>> gaborType;
 	_fs["main_precompute_gabor_wdsize"]			>> wdsize;
+	if (!_fs["main_precompute_gabor_norm_approximate"].empty())
+		_fs["main_precompute_gabor_norm_approximate"]	>> normApproximate;
 	//...................................................................
-	list_files_all(fileList, directory.c_str(), ext.c_str());
+	ScanFiles(fileList, directory, ext);
 	cutil_create_new_dir_all(out_directory);
-	//introducing the thread
-	for (auto & filename : fileList)
+	//the bank keeps its kernels for the whole directory, the frames are processed
+	//in batches so every worker has (frame, scale) pairs to take
+	GaborBank	bank(scales, orientation, cv::Size(wdsize, wdsize), gaborType, normApproximate);
+	size_t		batch = 2 * max(1u, std::thread::hardware_concurrency());
+	for (size_t first = 0; first < fileList.size(); first += batch)
 	{
-		cout << filename << endl;
-		Mat		img = imread(filename, CV_LOAD_IMAGE_GRAYSCALE);
-		if (_scale > 0)
-			resize(img, img, Size(), _scale, _scale, INTER_CUBIC);
-		auto	vecGabor = supp_gabor_filter(img, scales, orientation, cv::Size(wdsize, wdsize), gaborType);
-		string  saveFile = out_directory + "/" + 
-						   cutil_LastName(filename) + "_gabor.yml";
-		FileStorage fs(saveFile, FileStorage::WRITE);
-		for (size_t i = 0; i < vecGabor.size(); ++i)
+		size_t					last = min(first + batch, fileList.size());
+		vector<Mat>				imgs;
+		vector<gabor_res>		vecGabor;
+		for (size_t i = first; i < last; ++i)
 		{
-			stringstream ss;
-			ss << "scale" << i;
-			fs << ss.str() << vecGabor[i];
+			cout << fileList[i] << endl;
+			Mat		img = supp_timed(STAGE_DECODE, [&]{ return imread(fileList[i], CV_LOAD_IMAGE_GRAYSCALE); });
+			supp_instrument().readFile(STAGE_DECODE, fileList[i]);
+			supp_timed(STAGE_RESIZE, [&]{ _prep.scale(img); });
+			imgs.push_back(img);
+		}
+		supp_timed(STAGE_FLOW, [&]{ bank.compute(imgs, vecGabor); });
+		supp_instrument().count(STAGE_FLOW, imgs.size());
+		for (size_t i = first; i < last; ++i)
+		{
+			InstrumentScope	io(STAGE_IO);
+			string	file = out_directory + "/" + cutil_LastName(fileList[i]) + "_gabor.bin";
+			supp_vectorMat2BIN(vecGabor[i - first], file);
+			supp_instrument().writtenFile(STAGE_IO, file);
 		}
-		
 	}
 }
 //==================================================================
@@ -293,6 +406,11 @@ void CrowdAnomalies::Feat_Extract()
 	case 3:
 	{
 		Feat_Extract_Online();
+		break;
+	}
+	case 4:{
+		Feat_Extract_Gabor_Stream();
+		break;
 	}
   }
 }
@@ -329,19 +447,52 @@ void CrowdAnomalies::Test_Offline()
   _fs["main_test_of_validation_type"] >> validation_type;
 
 	//-------------------------------------------------------------
-	FileStorage testfs(testFile, FileStorage::READ);
-	FileStorage trainfs(trainFile, FileStorage::READ);
-	trainfs["CuboidNumber"] >> cuboidnumber;
+	//each file is read by its extension, binary ones are loaded at once and
+	//matched through views
+	DescriptorReader	trainIn,
+						testIn;
+	{
+		InstrumentScope	io(STAGE_IO);
+		if (!trainIn.open(trainFile)){
+			cout << "cannot read " << trainFile << endl;
+			return;
+		}
+		if (!testIn.open(testFile)){
+			cout << "cannot read " << testFile << endl;
+			return;
+		}
+		supp_instrument().readFile(STAGE_IO, trainFile);
+		supp_instrument().readFile(STAGE_IO, testFile);
+	}
+	if (trainIn._cuboids != testIn._cuboids){
+		cout << "train and test have " << trainIn._cuboids << " and "
+			 << testIn._cuboids << " cuboids" << endl;
+		return;
+	}
+	cuboidnumber = (short)trainIn._cuboids;
 	vector<vector<bool> > finaloutvec(cuboidnumber);
+	//descriptors of a motion gated extraction, the still windows are normal
+	int		motionGate = 0;
+	if (!_fs["main_test_motion_gate"].empty())
+		_fs["main_test_motion_gate"] >> motionGate;
 
 	//adding threads...............................................
 	vector<thread> t(num_threads);
 	for (auto i = 0; i < cuboidnumber; ++i){
 		stringstream keyphrase;
 		keyphrase << "cuboid" << i;
-		trainfs[keyphrase.str()]  >> train;
-		testfs[keyphrase.str()]   >> test;
-		determinePatterns(train, test, finaloutvec[i], threshold, distancetype);
+		{
+			InstrumentScope	io(STAGE_IO);
+			train = trainIn.cuboid(i);
+			test  = testIn.cuboid(i);
+		}
+		supp_timed(STAGE_MATCH, [&]{
+			if (motionGate)
+				determinePatternsGated(train, test, finaloutvec[i], threshold, distancetype);
+			else
+				determinePatterns(train, test, finaloutvec[i], threshold, distancetype);
+		});
+		supp_instrument().count(STAGE_MATCH, test.rows);
 		cout << keyphrase.str()   << endl;
 		//thread increment________________________________________
 		/*t[i % num_threads] = thread(determinePatterns, ref(train), ref(test), ref(finaloutvec[i]), threshold, i);
@@ -351,6 +502,7 @@ void CrowdAnomalies::Test_Offline()
 		//________________________________________________________/**/
 	}
 	if (flagGtval == "true"){
+    InstrumentScope validate(STAGE_VALIDATE);
     switch (validation_type) {
     case 0:
       GTValidation(finaloutvec);
@@ -552,12 +704,10 @@ void CrowdAnomalies::GTValidation(vector<vector<bool> > & rpta){
   _fs["main_gtvalidation_cols"]		  >> cols;
 	
 
-	list_files_all(file_list, directory.c_str(), token.c_str());
-	sort(file_list.begin(), file_list.end());
+	ScanFiles(file_list, directory, token);
 	img0 =  imread(file_list.front());
 	
-	if (_scale > 0)
-		resize(img0, img0, Size(), _scale, _scale, INTER_CUBIC);
+	_prep.scale(img0);
 
 	if (!rows)rows = img0.rows;
   if (!cols)cols = img0.cols;
@@ -581,7 +731,7 @@ void CrowdAnomalies::GTValidation(vector<vector<bool> > & rpta){
 	{
 		//cout << i << " " << pos << endl;
 		Mat img  = imread(file_list[i], CV_BGR2GRAY);
-		if (_scale > 0)	resize(img, img, Size(), _scale, _scale, INTER_CUBIC);
+		_prep.scale(img);
 		Mat_<int> gt	= img;
 		validationFunctions[validationType] ( gt, grid, rpta, pos, munit );
 		
@@ -761,17 +911,17 @@ void CrowdAnomalies::Feat_Extract_Online()
 		_fs["main_feat_extract_video_file"]		  >> vidFile;
 		//.........................................................
 
-		OFdataType		image_vector;
+		OFdataType		image_vector, diffs;
 		OFvecParMat		of_out;
-		OpticalFlowBase	*oflow	= new OpticalFlowOCV;
+		OpticalFlowBase	*oflow	= new OpticalFlowOCV(_points);
+		FramePrep		prep	= _prep;	//the differences restart with every window
 		
 		//.........................................................
 		//video characteristics 
 		int nframes;
 		MyVideoCapture cap(vidFile);
     cap >> img;
-    if (_scale > 0)
-			  resize(img, img, Size(), _scale, _scale, INTER_CUBIC);
+    _prep.scale(img);
     if(!rows)rows = img.cols;
     if(!cols)cols = img.rows;
     nframes = cap.get(CV_CAP_PROP_FRAME_COUNT);
@@ -781,32 +931,44 @@ void CrowdAnomalies::Feat_Extract_Online()
 				_main_cuboid_over_width, _main_cuboid_over_height);
 		//.........................................................
 
-		OFBasedDescriptorBase * descrip = selectChildDes(_main_descriptor_type, _mainfile);
+		OFDescriptor<Trait_OM> * descrip = selectChildDes<Trait_OM>(_main_descriptor_type, _mainfile);
+		if (!descrip) return;
 		Trait_OM::DesInData		input;
-		Trait_OM::DesOutData	vecOutput(grid.size());	
+		Trait_OM::DesOutData	vecOutput;
 		input.second = grid;
 
 		for (int i = posini, range =1; i < posfin && i < nframes; i += _main_frame_interval, ++range)
 		{
 			cout << "Frame: " << i << endl;
-			cap.set(CV_CAP_PROP_POS_FRAMES, i);
-			cap >> img;
-      if (_scale > 0)
-			  resize(img, img, Size(), _scale, _scale, INTER_CUBIC);
+			supp_timed(STAGE_DECODE, [&]{
+				cap.set(CV_CAP_PROP_POS_FRAMES, i);
+				cap >> img;
+			});
+			Mat		gray, diff;
+			supp_timed(STAGE_RESIZE, [&]{ prep.next(img, gray, diff); });
 			image_vector.push_back(img.clone());
+			if (!diff.empty())
+				diffs.push_back(diff);
 			if (range % _main_frame_range == 0)
 			{
-				oflow->compute(image_vector, of_out);
+				if (_gated)
+					_gate.gate(diffs, grid, descrip->_active, oflow->_roi);
+				oflow->_diffs = diffs;
+				supp_timed(STAGE_FLOW, [&]{ oflow->compute(image_vector, of_out); });
+				supp_instrument().count(STAGE_FLOW, of_out.size());
 				input.first = of_out;
 
-				descrip->Describe(&input, &vecOutput);
+				supp_timed(STAGE_DESCRIBE, [&]{ descrip->Describe(input, vecOutput); });
+				supp_instrument().count(STAGE_DESCRIBE, grid.size());
 
 				image_vector.clear();
+				diffs.clear();
+				prep.reset();
 				of_out.clear();
 			}
 		}
 		string path = dir_out + "/" + cutil_LastName(vidFile) + token_out;
-		supp_vectorMat2YML< Mat_<float> >(vecOutput, path, string("cuboid"));
+		WriteSink(vecOutput, path);
 	}
 
 }
@@ -832,9 +994,17 @@ void CrowdAnomalies::ComputeThrValueForTrain()
   _fs["computethrvaluefortrain_out_file"] >> out_file;
   _fs["computethrvaluefortrain_amount"]   >> amount;
   //....................................................................
-  FileStorage trainfs(trainFile, FileStorage::READ);
+  DescriptorReader trainIn;
+  {
+    InstrumentScope io(STAGE_IO);
+    if (!trainIn.open(trainFile)){
+      cout << "cannot read " << trainFile << endl;
+      return;
+    }
+    supp_instrument().readFile(STAGE_IO, trainFile);
+  }
+  cuboidnumber = trainIn._cuboids;
   FileStorage outfs(out_file, FileStorage::WRITE);
-	trainfs["CuboidNumber"] >> cuboidnumber;
 	
   //adding threads...............................................
 	
@@ -845,8 +1015,9 @@ void CrowdAnomalies::ComputeThrValueForTrain()
 		stringstream keyphrase;
 		keyphrase << "cuboid" << i;
     cout << keyphrase.str() << endl;
-		trainfs[keyphrase.str()]  >> train;
-    thrOut(0, i) = supp_computeMeanDistanceTrain(train, amount);
+    train = supp_timed(STAGE_IO, [&]{ return trainIn.cuboid(i); });
+    thrOut(0, i) = supp_timed(STAGE_MATCH, [&]{ return supp_computeMeanDistanceTrain(train, amount); });
+    supp_instrument().count(STAGE_MATCH, train.rows);
 	}
   outfs << "Thrs" << thrOut;
 }
@@ -870,7 +1041,8 @@ void CrowdAnomalies::Feat_Extract_OFCM(){
             maxMagnitude,
             logQuantization,
             movementFilter,
-            temporalScales;
+            temporalScales,
+            streaming = 0;
 	cutil_file_cont				    file_list;
 	//vector<cutil_grig_point>	grid;
   vector<int>               vect;
@@ -894,18 +1066,26 @@ void CrowdAnomalies::Feat_Extract_OFCM(){
   _fs["movementFilter"] >> movementFilter;
   _fs["temporalScales"] >> temporalScales;
   vect.push_back(temporalScales);
+  //streaming keeps just one window of frames in memory, older files have no key
+  if (!_fs["main_feat_extract_ofcm_streaming"].empty())
+    _fs["main_feat_extract_ofcm_streaming"] >> streaming;
   //.............................................................
-  list_files_all(file_list, directory.c_str(), token.c_str());
-  in.resize(file_list.size());
+  ScanFiles(file_list, directory, token);
 	cutil_create_new_dir_all(dir_out);
+  if (streaming){
+    Feat_Extract_OFCM_Stream(file_list, dir_out + "/" + token_out, nBinsMagnitude, nBinsAngle, distanceMagnitude,
+      distanceAngle, cuboidLength, maxMagnitude, logQuantization, movementFilter, vect);
+    return;
+  }
+  in.resize(file_list.size());
 	//introducing the thread
   size_t i = 0;
 	for (auto & filename : file_list)
 	{
 		cout << filename << endl;
-		Mat		img = imread(filename, CV_LOAD_IMAGE_GRAYSCALE);
-		if (_scale > 0)
-			resize(img, img, Size(), _scale, _scale, INTER_CUBIC);
+		Mat		img = supp_timed(STAGE_DECODE, [&]{ return imread(filename, CV_LOAD_IMAGE_GRAYSCALE); });
+		supp_instrument().readFile(STAGE_DECODE, filename);
+		supp_timed(STAGE_RESIZE, [&]{ _prep.scale(img); });
     in[i++] = img;
 	}
   rows = in[0].rows;
@@ -928,26 +1108,31 @@ void CrowdAnomalies::Feat_Extract_OFCM(){
   }
   ////////////////////////////////////////////////////////////////////////////////////////
 
-  DescriptorTemporal * desc = new OFCM(nBinsMagnitude, nBinsAngle, distanceMagnitude, distanceAngle, cuboidLength, maxMagnitude, logQuantization, static_cast<bool>(movementFilter), vect);
-  desc->setData(in);
-  desc->extract(cuboids, output);
+  OFCM * ofcm = new OFCM(nBinsMagnitude, nBinsAngle, distanceMagnitude, distanceAngle, cuboidLength, maxMagnitude, logQuantization, static_cast<bool>(movementFilter), vect);
+  ofcm->setPointSampling(_points.stride, _points.cellSize, _points.cellCap);
+  DescriptorTemporal * desc = ofcm;
+  //setData computes the optical flows
+  supp_timed(STAGE_FLOW, [&]{ desc->setData(in); });
+  supp_instrument().count(STAGE_FLOW, in.size());
+  vector<int> rowCuboids;
+  supp_timed(STAGE_DESCRIBE, [&]{ desc->extractParallel(cuboids, output, 0, &rowCuboids); });
+  supp_instrument().count(STAGE_DESCRIBE, cuboids.size());
   
-  vector<Mat_<float>> vecout;
+  //the cuboids of a spatial position are consecutive, one per window; each row
+  //goes to its own slot and the still cuboids (movementFilter) keep a zero histogram
+  HistogramSink vecout;
   int observed = in.size() / sampleL;
-
-  for (int i = 0; i < output.rows; i+=observed){
-    Mat_<float> cuboid_descriptor(observed,output.cols);
-    for (int j = i, x =0; j < i + observed; ++j,++x){
-      for (int k = 0; k < output.cols; ++k){
-        cuboid_descriptor(x, k) = output.at<float>(j,k);
-      }
-    }
-
-    vecout.push_back(cuboid_descriptor);
+  if (!cuboids.empty() && observed > 0){
+    int length = desc->getDescriptorLength(cuboids[0]);
+    vecout.reserve(observed);
+    for (int w = 0; w < observed; ++w)
+      vecout.beginWindow((int)cuboids.size() / observed, length);
+    for (int r = 0; r < output.rows; ++r)
+      std::copy_n(output.ptr<float>(r), length, vecout.histogram(rowCuboids[r] % observed, rowCuboids[r] / observed));
   }
   
   string path = dir_out + "/" + token_out;
-	supp_vectorMat2YML<Mat_<float>>(vecout, path, string("cuboid"));
+	WriteSink(vecout, path);
 		
 	cout << " Des-OK\n";
 
@@ -957,6 +1142,70 @@ void CrowdAnomalies::Feat_Extract_OFCM(){
   
 }
 
+//==================================================================
+//Streaming version of Feat_Extract_OFCM: the frames are read one by one and
+//only the last window stays in memory, when a temporal window closes the row of
+//each spatial cuboid is appended to its own output matrix
+void CrowdAnomalies::Feat_Extract_OFCM_Stream(cutil_file_cont & file_list, string path,
+  short nBinsMagnitude, short nBinsAngle, short distanceMagnitude, short distanceAngle,
+  short cuboidLength, short maxMagnitude, short logQuantization, short movementFilter,
+  vector<int> & temporalScales)
+{
+  short sampleX = _main_cuboid_width,
+        sampleY = _main_cuboid_height,
+        sampleL = _main_frame_range,
+        strideX = _main_cuboid_over_width,
+        strideY = _main_cuboid_over_height;
+  vector<Cube>          cuboids;
+  HistogramSink         vecout(HistogramSink::WINDOW_MAJOR);
+  vector<int>           rowCuboids;
+  Mat                   output;
+  int                   frames = 0;
+
+  //the descriptor keeps cuboidLength + max(temporalScales) frames, enough for a whole window
+  OFCM desc(nBinsMagnitude, nBinsAngle, distanceMagnitude, distanceAngle, max(cuboidLength, sampleL), maxMagnitude, logQuantization, static_cast<bool>(movementFilter), temporalScales);
+  desc.setPointSampling(_points.stride, _points.cellSize, _points.cellCap);
+
+  for (auto & filename : file_list)
+  {
+    cout << filename << endl;
+    Mat		img = supp_timed(STAGE_DECODE, [&]{ return imread(filename, CV_LOAD_IMAGE_GRAYSCALE); });
+    supp_instrument().readFile(STAGE_DECODE, filename);
+    supp_timed(STAGE_RESIZE, [&]{ _prep.scale(img); });
+
+    //spatial grid, the same for every window
+    if (cuboids.empty()){
+      for (int x = 0; x <= static_cast<int>(img.rows - sampleX); x += strideX)
+        for (int y = 0; y <= static_cast<int>(img.cols - sampleY); y += strideY)
+          cuboids.push_back(Cube(x, y, 0, sampleX, sampleY, sampleL));
+      vecout.reserve((int)(file_list.size() / sampleL));
+    }
+
+    //pushFrame computes the optical flows of the new frame
+    supp_timed(STAGE_FLOW, [&]{ desc.pushFrame(img); });
+    supp_instrument().count(STAGE_FLOW, 1);
+    if (++frames % sampleL)
+      continue;
+
+    //the window of the last sampleL frames is closed
+    for (auto & cuboid : cuboids)
+      cuboid.t0 = desc.getNumImages() - sampleL;
+    supp_timed(STAGE_DESCRIBE, [&]{ desc.extractParallel(cuboids, output, 0, &rowCuboids); });
+    supp_instrument().count(STAGE_DESCRIBE, cuboids.size());
+    //every window has its rows, the still cuboids (all of them in a still
+    //window) keep a zero histogram
+    if (cuboids.empty())
+      continue;
+    int window = vecout.beginWindow((int)cuboids.size(), desc.getDescriptorLength(cuboids[0]));
+    for (int i = 0; i < output.rows; ++i)
+      std::copy_n(output.ptr<float>(i), output.cols, vecout.histogram(window, rowCuboids[i]));
+  }
+
+  WriteSink(vecout, path);
+
+  cout << " Des-OK\n";
+}
+
 
 
 
@@ -972,7 +1221,7 @@ void CrowdAnomalies::Feat_Extract_OFCM(){
 void CrowdAnomalies::CommonLoadInfo(cutil_file_cont & file_list, string & directory,
 string key, const char * token, vector<cutil_grig_point> & grid, short &rows, short  &cols){
 	Mat			img;
-	list_files_all(file_list, directory.c_str(), token);
+	ScanFiles(file_list, directory, token);
 	if(key=="")
 		img =  imread(file_list.front());
 	else{
@@ -1020,6 +1269,30 @@ static void determinePatterns(Mat & train, Mat & test, vector<bool> & out, float
 	
 	//
 }
+//______________________________________________________________________________
+//windows of a motion gated extraction: the still ones have a zero histogram
+//and are normal without matching, only the others go to determinePatterns
+void determinePatternsGated(Mat & train, Mat & test, vector<bool> & out, float thr, int type)
+{
+	vector<int>		moving;
+	for (int r = 0; r < test.rows; ++r)
+		if (countNonZero(test.row(r)))
+			moving.push_back(r);
+	if ((int)moving.size() == test.rows){
+		determinePatterns(train, test, out, thr, type);
+		return;
+	}
+	out.assign(test.rows, true);
+	if (moving.empty())
+		return;
+	Mat				sub((int)moving.size(), test.cols, test.type());
+	vector<bool>	subOut;
+	for (size_t k = 0; k < moving.size(); ++k)
+		test.row(moving[k]).copyTo(sub.row((int)k));
+	determinePatterns(train, sub, subOut, thr, type);
+	for (size_t k = 0; k < moving.size(); ++k)
+		out[moving[k]] = subOut[k];
+}
 ////////////////////////////////////////////////////////////////////////////////
 //==========================================================================
 //draw rectangles
@@ -1092,11 +1365,9 @@ void CrowdAnomalies::Graphix( vector<vector<bool> > &rpta )
 		cutil_create_new_dir_all(directory_out);
 
 		Mat			img0;
-		list_files_all(file_list, directory.c_str(), file_extension.c_str());
-    sort(file_list.begin(), file_list.end());
+		ScanFiles(file_list, directory, file_extension);
 		img0 = imread(file_list.front());
-		if (_scale > 0)
-			resize(img0, img0, Size(), _scale, _scale, INTER_CUBIC);
+		_prep.scale(img0);
 		rows = img0.rows;
 		cols = img0.cols;
 		grid = grid_generator(rows, cols,
@@ -1110,8 +1381,7 @@ void CrowdAnomalies::Graphix( vector<vector<bool> > &rpta )
 			stringstream strout;
 			strout << directory_out << "/" << token_out << pos << "." << file_extension_out;
 			Mat img = imread(file_list[i]);
-			if (_scale > 0)
-				resize(img, img, Size(), _scale, _scale, INTER_CUBIC);
+			_prep.scale(img);
 			ShowAnomaly(img, pos, rpta, grid);
 			cout << "write: " << strout.str() << endl;
 			imwrite(strout.str(), img);
@@ -1135,8 +1405,7 @@ void CrowdAnomalies::Graphix( vector<vector<bool> > &rpta )
     //.........................................................................
     MyVideoCapture cap(file);
     cap >> img;
-    if (_scale > 0)
-      resize(img, img, Size(), _scale, _scale, INTER_CUBIC);
+    _prep.scale(img);
     //rows = img.cols;
     //cols = img.rows;
 
@@ -1162,7 +1431,7 @@ void CrowdAnomalies::Graphix( vector<vector<bool> > &rpta )
 			Mat img;
 			cap.set(CV_CAP_PROP_POS_FRAMES, i);
 			cap >> img;
-			if (_scale > 0)	resize(img, img, Size(), _scale, _scale, INTER_CUBIC);
+			_prep.scale(img);
 
 			ShowAnomaly(img, pos, rpta, grid);
 			cout << "write: " << strout.str() << endl;
@@ -1203,6 +1472,61 @@ bool CrowdAnomalies::CommonLoadInfo ( DirectoryNode *root, string key, const cha
 
 }
 ////////////////////////////////////////////////////////////////////////////////
+//key of the descriptor output of a sequence without its input files: the
+//output version, the descriptor type, the windows, every descriptor_* parameter
+//of the main file and the grid geometry; the callers add the content of the
+//input files
+ContentHash CrowdAnomalies::DescriptorKey(vector<cutil_grig_point> & grid){
+	ContentHash	key;
+	key.add((unsigned long long)descriptor_output_version);
+	key.add((unsigned long long)_main_descriptor_type);
+	key.add((unsigned long long)_main_frame_range);
+	FileNode	root = _fs.root();
+	for (FileNodeIterator it = root.begin(); it != root.end(); ++it){
+		FileNode	node = *it;
+		string		name = node.name();
+		//the number of workers does not change the output
+		if (name.compare(0, 11, "descriptor_") || name == "descriptor_numThreads")
+			continue;
+		key.add(name);
+		key.add(node);
+	}
+	key.add((unsigned long long)grid.size());
+	for (auto & cuboid : grid){
+		int	coords[4] = { cuboid.xi, cuboid.yi, cuboid.xf, cuboid.yf };
+		key.add(coords, sizeof(coords));
+	}
+	return key;
+}
+////////////////////////////////////////////////////////////////////////////////
+//every listing of the modes goes through the scanner, with the manifest of the
+//root and token under main_scan_manifest_dir when it is set
+void CrowdAnomalies::ScanTree(DirectoryNode * root, const string & token){
+	cutil_scan_options	opt = _scan;
+	if (!_scan_manifest_dir.empty()){
+		ContentHash	key;
+		key.add(root->_label);
+		key.add(token);
+		opt._manifest = _scan_manifest_dir + "/" + key.hex() + ".txt";
+	}
+	cutil_scan_tree(root, token.c_str(), opt);
+}
+//______________________________________________________________________________
+void CrowdAnomalies::ScanFiles(cutil_file_cont & files, const string & directory,
+							   const string & token){
+	DirectoryNode	root(directory);
+	ScanTree(&root, token);
+	cutil_tree_flatten(&root, files, nullptr);
+	root.Destroy();
+}
+////////////////////////////////////////////////////////////////////////////////
+//descriptor output of a mode, timed and counted as io.........................
+void CrowdAnomalies::WriteSink(HistogramSink & sink, const string & path){
+	InstrumentScope	io(STAGE_IO);
+	supp_sink2File(sink, path, string("cuboid"));
+	supp_instrument().writtenFile(STAGE_IO, path);
+}
+////////////////////////////////////////////////////////////////////////////////
 //Feat extraction OM creates feature vector using the orientation magnitude.....
 //descriptor....................................................................
 //inputs........................................................................
@@ -1229,13 +1553,21 @@ void CrowdAnomalies::Feat_Extract_OM(){
 
 	cutil_create_new_dir_all(dir_out);
 	DirectoryNode	root(directory);
-	list_files_all_tree(&root, token.c_str());
+	ScanTree(&root, token);
 	queue<DirectoryNode *> nodelist;
 
 	assert(CommonLoadInfo(&root, "angle", token.c_str(), grid, rows, cols));
 
+	//the sequences are independent, each one has its own descriptor and output
+	//file, so they are described by a pool of numThreads (0: one per core)
+	int		numThreads = 0;
+	if (!_fs["main_feat_extract_threads"].empty())
+		_fs["main_feat_extract_threads"] >> numThreads;
+
 	//..........................................................................
-	Mat		mainOut;
+	Mat							mainOut;
+	vector<DirectoryNode *>		sequences;
+	long long					windows = 0;
 	for (nodelist.push(&root); !nodelist.empty();)
 	{
 		auto current = nodelist.front();
@@ -1245,39 +1577,72 @@ void CrowdAnomalies::Feat_Extract_OM(){
 			nodelist.push(currentSon);
 
 		if (current->_listFile.size()){
-			DescribeSeq(*current, grid, mainOut, dir_out, token_out);
+			sequences.push_back(current);
+			windows += (current->_listFile.size() + _main_frame_range - 1) / _main_frame_range;
 		}
 	}
+	//with several sequences at once their descriptors run serial, otherwise the
+	//two pools would start up to cores^2 threads
+	int		pool = numThreads > 0 ? numThreads : max(1, (int)std::thread::hardware_concurrency()),
+			cuboidThreads = min(pool, (int)sequences.size()) > 1 ? 1 : 0;
+	ContentHash		key = DescriptorKey(grid);
+	ProgressReport	progress("windows", windows, 5.0);
+	supp_parallel_for((int)sequences.size(), [&](int k){
+		DescribeSeq(*sequences[k], grid, mainOut, dir_out, token_out, key, progress, cuboidThreads);
+	}, numThreads);
 }
 ////////////////////////////////////////////////////////////////////////////////
 //this function describes precomputed of images extracted from video////////////
 void CrowdAnomalies::DescribeSeq	( DirectoryNode & current, vector<cutil_grig_point> & grid, 
-									  Mat & mainOut, string & outDir,string & outToken){
+									  Mat & mainOut, string & outDir,string & outToken,
+									  const ContentHash & baseKey, ProgressReport & progress,
+									  int cuboidThreads){
 	
-	OFBasedDescriptorBase * descrip = selectChildDes(_main_descriptor_type, _mainfile);
-	Trait_OM::DesOutData	vecOutput(grid.size());
+	OFDescriptor<Trait_OM> * descrip = selectChildDes<Trait_OM>(_main_descriptor_type, _mainfile);
+	if (!descrip) return;
+	//workers of the cuboids, 0 keeps descriptor_numThreads
+	if (cuboidThreads > 0)
+		descrip->_numThreads = cuboidThreads;
+	Trait_OM::DesOutData	vecOutput;
+	string path = outDir + "/" + cutil_LastName(current._label) + outToken;
+
+	//same flow files and parameters as a previous run
+	ContentHash	key = baseKey;
+	for (auto & file : current._listFile)
+		key.addFile(file);
+	if (_cache.load(key.hex(), vecOutput)){
+		WriteSink(vecOutput, path);
+		progress.note(cutil_LastName(current._label) + " Des-OK (cached)");
+		progress.step(vecOutput.windows());
+		delete descrip;
+		return;
+	}
 	
 	size_t			step = _main_frame_range - 1;
 	Trait_OM::DesvecParMat	temporalset(step);
 	Trait_OM::DesInData		input;
 	input.second = grid;
+	vecOutput.reserve((int)(current._listFile.size() / (step + 1)) + 1);
 	
 	for (size_t i = 0; i < current._listFile.size(); i += step+1)
 	{
-		cout << i << endl;
 		for (int j = 0; j < step; ++j)
 		{
+			InstrumentScope	io(STAGE_IO);
 			FileStorage imgfs(current._listFile[i + j], FileStorage::READ);
 			imgfs["angle"]		>> temporalset[j].first;
 			imgfs["magnitude"]	>> temporalset[j].second;
+			supp_instrument().readFile(STAGE_IO, current._listFile[i + j]);
 		}
 		input.first = temporalset;
-		descrip->Describe(&input, &vecOutput);
+		supp_timed(STAGE_DESCRIBE, [&]{ descrip->Describe(input, vecOutput); });
+		supp_instrument().count(STAGE_DESCRIBE, grid.size());
+		progress.step();
 	}
-	string path = outDir + "/" + cutil_LastName(current._label) + outToken;
-	supp_vectorMat2YML< Mat_<float> >(vecOutput, path, string("cuboid"));
+	_cache.store(key.hex(), vecOutput);
+	WriteSink(vecOutput, path);
 		
-	cout << " Des-OK\n";
+	progress.note(cutil_LastName(current._label) + " Des-OK");
 	delete descrip;/**/
 }
 ////////////////////////////////////////////////////////////////////////////////
@@ -1314,15 +1679,29 @@ void CrowdAnomalies::Feat_Extract_Gabor(){
 
 	cutil_create_new_dir_all(dir_out);
 	DirectoryNode	root_of(directory_of);
-	list_files_all_tree(&root_of, token_of.c_str());
+	ScanTree(&root_of, token_of);
 	DirectoryNode	root_gabor(directory_gabor);
-	list_files_all_tree(&root_gabor, token_gabor.c_str());
+	ScanTree(&root_gabor, token_gabor);
 	
 
 	assert(CommonLoadInfo(&root_of, "angle", token_of.c_str(), grid, rows, cols));
-	OFBasedDescriptorBase * descrip = selectChildDes(_main_descriptor_type, _mainfile);
-	Trait_Gabor::DesOutData Out(grid.size());
+	OFDescriptor<Trait_Gabor> * descrip = selectChildDes<Trait_Gabor>(_main_descriptor_type, _mainfile);
+	if (!descrip) return;
+	Trait_Gabor::DesOutData Out;
 	int step = _main_frame_range - 1;
+	string path = dir_out + "/" + cutil_LastName(root_of._label) + token_out;
+
+	//same flow, gabor files and parameters as a previous run
+	ContentHash	key = DescriptorKey(grid);
+	for (auto & file : root_of._listFile)
+		key.addFile(file);
+	for (auto & file : root_gabor._listFile)
+		key.addFile(file);
+	if (_cache.load(key.hex(), Out)){
+		WriteSink(Out, path);
+		delete descrip;
+		return;
+	}
 	
 	//..........................................................................
 	
@@ -1336,6 +1715,9 @@ void CrowdAnomalies::Feat_Extract_Gabor(){
 
 		for (auto p_i = 0; p_i < step; ++p_i)
 		{
+			InstrumentScope	io(STAGE_IO);
+			supp_instrument().readFile(STAGE_IO, root_of._listFile[i + p_i]);
+			supp_instrument().readFile(STAGE_IO, root_gabor._listFile[i + p_i]);
 			FileStorage imgfs(root_of._listFile[i + p_i], FileStorage::READ);
 			Mat			angle, magnitude;
 			imgfs["angle"]		>> angle;
@@ -1343,7 +1725,21 @@ void CrowdAnomalies::Feat_Extract_Gabor(){
 			imgfs["magnitude"]	>> magnitude;
 			In.first [p_i].push_back(magnitude);
 
-			imgfs.open(root_gabor._listFile[i + p_i],    FileStorage::READ);
+			//binary store from Precompute_Gabor, older outputs are yml
+			string	gaborFile = root_gabor._listFile[i + p_i];
+			if (gaborFile.size() > 4 && gaborFile.compare(gaborFile.size() - 4, 4, ".bin") == 0)
+			{
+				vector<Mat>	scalesA;
+				if (!supp_BIN2vectorMat(gaborFile, scalesA) || scalesA.size() != (size_t)nscales){
+					cout << "cannot read " << gaborFile << ": expected " << nscales
+						<< " scales" << endl;
+					delete descrip;
+					return;
+				}
+				In.first[p_i].insert(In.first[p_i].end(), scalesA.begin(), scalesA.end());
+				continue;
+			}
+			imgfs.open(gaborFile,    FileStorage::READ);
 			for (int sc = 0; sc < nscales; ++sc)
 			{
 				Mat scaleA;
@@ -1353,11 +1749,122 @@ void CrowdAnomalies::Feat_Extract_Gabor(){
 				In.first[p_i].push_back(scaleA);
 			}
 		}
-		descrip->Describe(&In, &Out);
+		supp_timed(STAGE_DESCRIBE, [&]{ descrip->Describe(In, Out); });
+		supp_instrument().count(STAGE_DESCRIBE, grid.size());
 	}
 	
-	string path = dir_out + "/" + cutil_LastName(root_of._label) + token_out;
-	supp_vectorMat2YML< Mat_<float> >(Out, path, string("cuboid"));
+	_cache.store(key.hex(), Out);
+	WriteSink(Out, path);
+	delete descrip;
+}
+////////////////////////////////////////////////////////////////////////////////
+//Feat extraction gabor without precomputed files: the frames of each window
+//are read from the image directory, their optical flow and gabor scales are
+//computed in memory and every frame goes to the descriptor as (flow, argmax
+//scale map). Same windows as Feat_Extract_Gabor: range frames give range - 1
+//flows, each one paired with the gabor of its first frame
+//inputs........................................................................
+//directory with images, its extension
+//direcotry output
+//token out
+//gabor bank from main_precompute_gabor_*
+void CrowdAnomalies::Feat_Extract_Gabor_Stream(){
+	cout << "feat_gabor_stream" << endl;
+	string		directory,
+				ext,
+				dir_out,
+				token_out;
+	int			orientation,
+				scales,
+				gaborType,
+				wdsize,
+				normApproximate = 0;
+	cutil_file_cont				fileList;
+	vector<cutil_grig_point>	grid;
+	//-------------------------------------------------------------
+	//load info....................................................
+	_fs["main_feat_extract_dir_images"]			>> directory;
+	_fs["main_feat_extract_ext_images"]			>> ext;
+	_fs["main_feat_extract_output"]				>> dir_out;
+	_fs["main_feat_extract_token_out"]			>> token_out;
+	_fs["main_precompute_gabor_orientation"]	>> orientation;
+	_fs["main_precompute_gabor_scales"]			>> scales;
+	_fs["main_precompute_gabor_type"]			>> gaborType;
+	_fs["main_precompute_gabor_wdsize"]			>> wdsize;
+	if (!_fs["main_precompute_gabor_norm_approximate"].empty())
+		_fs["main_precompute_gabor_norm_approximate"]	>> normApproximate;
+
+	cutil_create_new_dir_all(dir_out);
+	ScanFiles(fileList, directory, ext);
+
+	//the input has its own frame type, so this descriptor is fixed
+	OFDescriptor<Trait_GaborMap> *	descrip = selectChildDes<Trait_GaborMap>(6, _mainfile);
+	if (!descrip) return;
+	//the histograms have one block per scale of the bank
+	int		gaborNumBin = 0;
+	_fs["descriptor_gaborNumBin"] >> gaborNumBin;
+	if (gaborNumBin != scales){
+		cout << "descriptor_gaborNumBin (" << gaborNumBin << ") must be main_precompute_gabor_scales ("
+			 << scales << ")" << endl;
+		delete descrip;
+		return;
+	}
+	GaborBank					bank(scales, orientation, cv::Size(wdsize, wdsize), gaborType, normApproximate);
+	OpticalFlowOCV				oflow(_points);
+	Trait_GaborMap::DesOutData	Out;
+	int							range = _main_frame_range;
+
+	//..........................................................................
+	for (size_t i = 0; i + range <= fileList.size(); i += range)
+	{
+		OFdataType					frames, grays, diffs;
+		OFvecParMat					of_out;
+		FramePrep					prep = _prep;
+		vector<gabor_res>			vecGabor;
+		Trait_GaborMap::DesInData	In;
+		cout << i << endl;
+
+		for (int p_i = 0; p_i < range; ++p_i)
+		{
+			Mat		img = supp_timed(STAGE_DECODE, [&]{ return imread(fileList[i + p_i]); }), gray, diff;
+			supp_instrument().readFile(STAGE_DECODE, fileList[i + p_i]);
+			supp_timed(STAGE_RESIZE, [&]{ prep.next(img, gray, diff); });
+			frames.push_back(img);
+			grays.push_back(gray);
+			if (!diff.empty())
+				diffs.push_back(diff);
+		}
+		if (grid.empty())
+		{
+			grid = grid_generator(frames[0].rows, frames[0].cols,
+				_main_cuboid_width, _main_cuboid_height,
+				_main_cuboid_over_width, _main_cuboid_over_height);
+		}
+		if (_gated)
+			_gate.gate(diffs, grid, descrip->_active, oflow._roi);
+		oflow._diffs = diffs;
+		//the last frame only closes the last flow
+		grays.pop_back();
+		supp_timed(STAGE_FLOW, [&]{
+			bank.compute(grays, vecGabor);
+			oflow.compute(frames, of_out);
+		});
+		supp_instrument().count(STAGE_FLOW, of_out.size());
+
+		In.second = grid;
+		In.first.resize(of_out.size());
+		for (size_t p_i = 0; p_i < of_out.size(); ++p_i)
+		{
+			In.first[p_i].first = of_out[p_i];
+			supp_gabor_argmax(vecGabor[p_i], In.first[p_i].second);
+		}
+		supp_timed(STAGE_DESCRIBE, [&]{ descrip->Describe(In, Out); });
+		supp_instrument().count(STAGE_DESCRIBE, grid.size());
+	}
+
+	string path = dir_out + "/" + cutil_LastName(directory) + token_out;
+	WriteSink(Out, path);
+	delete descrip;
 }
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -1373,7 +1880,7 @@ void CrowdAnomalies::RepairPeds2()
   _fs["main_repair_token"]	        >> token;
 
   cutil_file_cont list;
-  list_files_all(list, directory.c_str(), token.c_str());
+  ScanFiles(list, directory, token);
   std::sort(list.begin(), list.end(), cmpStrNum);
   int nfiles = list.size();
   for (size_t i = 0; i < nfiles; ++i){
@@ -1417,7 +1924,7 @@ void threadedTask(string file)
 
 //loading images into a vector
 void loadImages2Vec(std::string &src, int type, std::string &file_ext,
-	float scale, int step, std::vector< cv::Mat > & image_vector)
+	const FramePrep & prep, int step, std::vector< cv::Mat > & image_vector)
 {
 	image_vector.clear();
 	switch (type)
@@ -1428,9 +1935,9 @@ void loadImages2Vec(std::string &src, int type, std::string &file_ext,
 		  list_files_all(file_list, src.c_str(), file_ext.c_str());
 		  for (size_t i = 0; i < file_list.size(); ++i)
 		  {
-			  Mat	img = imread(file_list[i]);
-			  if (scale > 0)
-				  resize(img, img, Size(), scale, scale, INTER_CUBIC);
+			  Mat	img = supp_timed(STAGE_DECODE, [&]{ return imread(file_list[i]); });
+			  supp_instrument().readFile(STAGE_DECODE, file_list[i]);
+			  supp_timed(STAGE_RESIZE, [&]{ prep.scale(img); });
 			  image_vector.push_back(img);
 		  }
 	}
@@ -1440,9 +1947,8 @@ void loadImages2Vec(std::string &src, int type, std::string &file_ext,
 		  if (cap.isOpened())
 		  {
 			  cv::Mat img;
-			  for (short i = 0; cap.increment(step, img); i+=step){
-				  if (scale > 0)
-					  resize(img, img, Size(), scale, scale, INTER_CUBIC);
+			  for (short i = 0; supp_timed(STAGE_DECODE, [&]{ return cap.increment(step, img); }); i+=step){
+				  supp_timed(STAGE_RESIZE, [&]{ prep.scale(img); });
 				  image_vector.push_back(img.clone());
 			  }
 		  }
@@ -1,21 +1,255 @@
 #ifndef HDESCRIPTOR_H
 #define HDESCRIPTOR_H
 #include "CUtil.h"
+#include "Support.h"
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv/cv.h"
 #include <type_traits>
 #include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define DESCRIPTOR_SSE2
+#endif
+
+//version of the descriptor outputs, part of the cache keys: bump it with any
+//change of the histograms (binning, normalization) or of their format, so the
+//outputs cached by older runs are not served
+static const int descriptor_output_version = 1;
+
 ////////////////////////////////////////////////////////////////////
 //==================================================================
-//struct base for magnitude orientation descriptor
+//struct base for optical flow descriptors, only what does not depend on
+//the input type (configuration and destruction)
 struct OFBasedDescriptorBase
 {
 	OFBasedDescriptorBase(){}
+	virtual ~OFBasedDescriptorBase(){}
 	virtual void setData(std::string file){}
-	virtual void Describe(void *, void *) = 0;
 };
 //==================================================================
+//descriptor interface for one input trait: a window is described with its
+//own types, so the only virtual call is the one per window and everything
+//inside is compiled for the concrete descriptor
+template <class tr>
+struct OFDescriptor : public OFBasedDescriptorBase
+{
+	typedef typename  tr::DesInData		DesInData;
+	typedef typename  tr::DesOutData	DesOutData;
+
+	int		_numThreads;	//workers for the cuboids, 0 one per core
+	std::vector<uchar>	_active;	//cuboids of the next windows (MotionGate), empty all
+	OFDescriptor() : _numThreads(1){}
+
+	virtual void Describe(DesInData & in, DesOutData & out) = 0;
+};
+//==================================================================
+//runs f(c) for every cuboid of the grid. With more than one worker the grid
+//is split in horizontal bands (the cuboids that start in the same row), so
+//a worker reads a contiguous block of rows of each frame. Every cuboid has
+//its own histogram, so the result is the one of the serial loop. The
+//cuboids that are not active (when active is not empty) are skipped and keep
+//the zero histogram of the window
+template <class F>
+void forEachCuboid(const std::vector<cutil_grig_point> & grid, int numThreads,
+				   const std::vector<uchar> & active, F f)
+{
+	auto run = [&](int c){
+		if (active.empty() || active[c])
+			f(c);
+	};
+	if (numThreads == 1 || grid.size() < 2)
+	{
+		for (int c = 0; c < (int)grid.size(); ++c)
+			run(c);
+		return;
+	}
+	std::vector<int> bands;
+	for (int c = 0; c < (int)grid.size(); ++c)
+		if (!c || grid[c].xi != grid[c - 1].xi)
+			bands.push_back(c);
+	bands.push_back((int)grid.size());
+	supp_parallel_for((int)bands.size() - 1, [&](int b){
+		for (int c = bands[b]; c < bands[b + 1]; ++c)
+			run(c);
+	}, numThreads);
+}
+//==================================================================
+//motion gate of the windows of a video: the gray difference of every
+//consecutive pair (FramePrep) marks the cuboids with enough moving pixels as active.
+//The still ones skip the flow, the histograms (they stay zero) and, with
+//main_test_motion_gate, the matching, where they are normal. Every _refresh
+//windows (0 never) all the cuboids are processed
+struct MotionGate
+{
+	int		_thr			= 30;	//gray difference of a moving pixel
+	double	_minFraction	= 0.01;	//moving pixels per pixel and pair of a cuboid
+	int		_refresh		= 0;
+	int		_window			= 0;	//windows gated so far
+
+	//active flag of every cuboid for the frames of the next window and the
+	//pixel mask of the active cuboids, empty when all of them are active;
+	//gives the number of active cuboids
+	int gate(const std::vector<cv::Mat> & diffs, const std::vector<cutil_grig_point> & grid,
+			 std::vector<uchar> & active, cv::Mat & roi)
+	{
+		bool	full = _refresh > 0 && _window % _refresh == 0;
+		_window++;
+		active.assign(grid.size(), 1);
+		roi.release();
+		if (full || diffs.empty())
+			return (int)grid.size();
+
+		//moving pixels of each pair, counted per pixel (it saturates at 255)
+		cv::Mat		moving, counts, sum;
+		counts = cv::Mat::zeros(diffs[0].size(), CV_8U);
+		for (auto & diff : diffs)
+		{
+			cv::threshold(diff, moving, _thr, 1, cv::THRESH_BINARY);
+			cv::add(counts, moving, counts);
+		}
+		cv::integral(counts, sum, CV_32S);
+
+		int		pairs	= (int)diffs.size(),
+				numActive = 0;
+		for (size_t c = 0; c < grid.size(); ++c)
+		{
+			auto &	cub		= grid[c];
+			int		n		= sum.at<int>(cub.xf + 1, cub.yf + 1) - sum.at<int>(cub.xi, cub.yf + 1) -
+							  sum.at<int>(cub.xf + 1, cub.yi) + sum.at<int>(cub.xi, cub.yi);
+			double	area	= (double)(cub.xf - cub.xi + 1) * (cub.yf - cub.yi + 1);
+			active[c] = n > 0 && n >= _minFraction * area * pairs;
+			numActive += active[c];
+		}
+		if (numActive < (int)grid.size())
+		{
+			roi = cv::Mat::zeros(counts.size(), CV_8U);
+			for (size_t c = 0; c < grid.size(); ++c)
+				if (active[c])
+					roi(cv::Rect(grid[c].yi, grid[c].xi, grid[c].yf - grid[c].yi + 1,
+								 grid[c].xf - grid[c].xi + 1)).setTo(1);
+		}
+		return numActive;
+	}
+};
+//==================================================================
+//orientation x magnitude bins of the flow histograms. ORI and MAG fix the
+//counts at compile time (0 = known at run time only), so the bin index of
+//the common configurations folds into constants
+template <int ORI, int MAG>
+struct FlowBins
+{
+	enum { none = 0xFFFF };	//bin plane value of the pixels without movement
+
+	int	_orient,
+		_magnitude;
+	FlowBins(int orient = ORI, int magnitude = MAG) :
+		_orient(orient), _magnitude(magnitude){}
+
+	int orient() const		{ return ORI ? ORI : _orient; }
+	int magnitude() const	{ return MAG ? MAG : _magnitude; }
+	//the last magnitude bin takes everything above the maximum
+	int size() const		{ return orient() * (magnitude() + 1); }
+	int index(int p, int s) const { return p * (magnitude() + 1) + s; }
+	double orientRange() const { return 360.0 / orient(); }
+};
+//==================================================================
+//calls f once with the FlowBins of the configuration, specialized when it
+//is one of the usual ones
+template <class F>
+void dispatchFlowBins(int orient, int magnitude, F f)
+{
+	if		(orient == 8  && magnitude == 4) f(FlowBins<8, 4>());
+	else if (orient == 8  && magnitude == 8) f(FlowBins<8, 8>());
+	else if (orient == 16 && magnitude == 4) f(FlowBins<16, 4>());
+	else if (orient == 16 && magnitude == 8) f(FlowBins<16, 8>());
+	else									 f(FlowBins<0, 0>(orient, magnitude));
+}
+//==================================================================
+//bin of every pixel of a flow frame, packed as bins.index(p, s), or
+//bins.none where the magnitude is not above thr, so the descriptors only
+//look up and increment. The bin widths are applied as products by their
+//reciprocals, 8 pixels at a time with SSE2; the scalar tail does the same
+//float operations, so both give the same bins. An orientation of 360 falls
+//in the first bin
+template <class Bins>
+void flowBinPlane(const Bins & bins, const cv::Mat_<float> & ori,
+				  const cv::Mat_<float> & mag, float thr, float maxMagnitude,
+				  cv::Mat_<ushort> & out)
+{
+	const int	orient		= bins.orient(),
+				magnitude	= bins.magnitude();
+	const float	oriScale	= (float)(orient / 360.0),
+				magScale	= (float)(magnitude / (double)maxMagnitude),
+				magTop		= (float)magnitude;
+	CV_Assert(bins.size() < 0x7FFF);
+	out.create(ori.rows, ori.cols);
+	for (int i = 0; i < ori.rows; ++i)
+	{
+		const float	*o	= ori[i],
+					*m	= mag[i];
+		ushort		*b	= out[i];
+		int			j	= 0;
+#ifdef DESCRIPTOR_SSE2
+		const __m128	vOriScale	= _mm_set1_ps(oriScale),
+						vMagScale	= _mm_set1_ps(magScale),
+						vMagTop		= _mm_set1_ps(magTop),
+						vThr		= _mm_set1_ps(thr);
+		const __m128i	vOrient		= _mm_set1_epi32(orient),
+						vStride		= _mm_set1_epi16((short)(magnitude + 1)),
+						vNone		= _mm_set1_epi16((short)bins.none);
+		for (; j + 8 <= ori.cols; j += 8)
+		{
+			__m128i p[2], s[2], moving[2];
+			for (int h = 0; h < 2; ++h)
+			{
+				__m128	vo = _mm_loadu_ps(o + j + 4 * h),
+						vm = _mm_loadu_ps(m + j + 4 * h);
+				p[h]		= _mm_cvttps_epi32(_mm_mul_ps(vo, vOriScale));
+				p[h]		= _mm_and_si128(p[h], _mm_cmplt_epi32(p[h], vOrient));
+				s[h]		= _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(vm, vMagScale), vMagTop));
+				moving[h]	= _mm_castps_si128(_mm_cmpgt_ps(vm, vThr));
+			}
+			__m128i idx	 = _mm_add_epi16(_mm_mullo_epi16(_mm_packs_epi32(p[0], p[1]), vStride),
+										 _mm_packs_epi32(s[0], s[1])),
+					mask = _mm_packs_epi32(moving[0], moving[1]);
+			_mm_storeu_si128((__m128i *)(b + j),
+				_mm_or_si128(_mm_and_si128(mask, idx), _mm_andnot_si128(mask, vNone)));
+		}
+#endif
+		for (; j < ori.cols; ++j)
+		{
+			if (!(m[j] > thr))
+			{
+				b[j] = (ushort)bins.none;
+				continue;
+			}
+			int p = (int)(o[j] * oriScale),
+				s = (int)(std::min)(m[j] * magScale, magTop);
+			if (p >= orient) p = 0;
+			b[j] = (ushort)bins.index(p, s);
+		}
+	}
+}
+//==================================================================
+//bin planes of all the frames of a window, flow(frame) gives the
+//(orientation, magnitude) pair of a frame
+template <class Bins, class Frames, class Flow>
+void flowBinPlanes(const Bins & bins, const Frames & frames, Flow flow, float thr,
+				   float maxMagnitude, int numThreads, std::vector< cv::Mat_<ushort> > & planes)
+{
+	planes.resize(frames.size());
+	auto plane = [&](int f){
+		auto fl = flow(frames[f]);
+		flowBinPlane(bins, fl.first, fl.second, thr, maxMagnitude, planes[f]);
+	};
+	if (numThreads == 1)
+		for (int f = 0; f < (int)frames.size(); ++f)
+			plane(f);
+	else
+		supp_parallel_for((int)frames.size(), plane, numThreads);
+}
+//==================================================================
 //==================================================================
 //trait for MO descriptor
 struct Trait_OM
@@ -25,12 +259,12 @@ struct Trait_OM
 	typedef std::vector<cutil_grig_point>					        CuboTypeCont;
 	typedef cv::Mat_<float>									              HistoType;
 	typedef std::pair<DesvecParMat, CuboTypeCont>			    DesInData;	//input data type
-	typedef std::vector<HistoType>							          DesOutData;//output data type
+	typedef HistogramSink									          DesOutData;//output data type
 };
 //==================================================================
 //descriptor magnitude orientation  
 template <class tr>
-struct OFBasedDescriptorMO : public OFBasedDescriptorBase
+struct OFBasedDescriptorMO final : public OFDescriptor<tr>
 {
 	typedef typename  tr::DesInData		DesInData;
 	typedef typename  tr::DesOutData	DesOutData;
@@ -42,47 +276,38 @@ struct OFBasedDescriptorMO : public OFBasedDescriptorBase
 			  _thrMagnitude;
 	//______________________________________________________________
 	
-	virtual void Describe(void * invoid, void *outvoid)
+	void Describe(DesInData & in, DesOutData & out) override
 	{
-
-		DesInData & in		= *((DesInData*)(invoid));
-		DesOutData & out	= *((DesOutData*)(outvoid));
-
-		double	binRange		= 360 / _orientNumBin,
-				binVelozRange	= _maxMagnitude / (float)_magnitudeBin;
-		int		cubPos			= 0;
+		dispatchFlowBins(_orientNumBin, _magnitudeBin, [&](auto bins){
+			this->describeBins(bins, in, out);
+		});
+	}
+	//______________________________________________________________
+	template <class Bins>
+	void describeBins(const Bins & bins, DesInData & in, DesOutData & out)
+	{
+		std::vector< cv::Mat_<ushort> >	planes;
+		flowBinPlanes(bins, in.first, [](const typename tr::DesparMat & fr){ return fr; },
+					  _thrMagnitude, _maxMagnitude, this->_numThreads, planes);
 		
-		for (auto & cuboid : in.second ) //for each cuboid
+		int		window			= out.beginWindow((int)in.second.size(), bins.size());
+		
+		forEachCuboid(in.second, this->_numThreads, this->_active, [&](int c) //for each cuboid
 		{
 
-			HistoType histogram(1, _orientNumBin * (_magnitudeBin + 1));
-			histogram = histogram * 0;
-			for (auto & imgPair : in.first) // for each image
+			auto & cuboid = in.second[c];
+			float *hist = out.histogram(window, c);
+			for (auto & plane : planes) // for each image
 			{
-				Mat frm(imgPair.second.rows,imgPair.second.cols, CV_8SC3);
-				frm = frm * 0;
-				cv::rectangle(	frm,
-					cv::Point(cuboid.yi , cuboid.xi),
-					cv::Point(cuboid.yf, cuboid.xf), 
-					cv::Scalar(0, 0, 255) );/**/
 				for (int i = cuboid.xi; i <= cuboid.xf; ++i)
 				{
+					const ushort *bin = plane[i];
 					for (int j = cuboid.yi; j <= cuboid.yf; ++j)
-					{
-						if (imgPair.second(i, j) > _thrMagnitude)
-						{
-							int p = (int)(imgPair.first(i, j) / binRange);
-							int s = (int)(imgPair.second(i, j) / binVelozRange);
-              if (p >= _orientNumBin) p = 0;
-							if (s >= _magnitudeBin) s = _magnitudeBin;
-							//histogram(0, p*(_magnitudeBin+1) + s) += imgPair.second(i, j);
-							++histogram(0, p*(_magnitudeBin+1) + s);
-						}
-					}
+						if (bin[j] != bins.none)
+							++hist[bin[j]];
 				}
 			}
-			out[cubPos++].push_back(histogram);
-		}
+		});
 	}
 	virtual void setData(std::string file){
 		cv::FileStorage fs(file, cv::FileStorage::READ);
@@ -106,12 +331,14 @@ struct Trait_M
 	typedef std::vector<cutil_grig_point>			CuboTypeCont;
 	typedef std::vector<cv::Mat_<float> >			vecMatMag;
 	typedef std::pair<vecMatMag, CuboTypeCont>		DesInDataMag;	//input data type
-	typedef std::vector<HistoType>					  DesOutDataMag;//output data type
+	typedef HistogramSink							  DesOutDataMag;//output data type
+	typedef DesInDataMag							DesInData;
+	typedef DesOutDataMag							DesOutData;
 };
 ////////////////////////////////////////////////////////////////////////////////
 //Simple magnitude descriptor...................................................
 template <class tr>
-struct OFBasedDescriptorMagnitude : public OFBasedDescriptorBase
+struct OFBasedDescriptorMagnitude final : public OFDescriptor<tr>
 {
 	typedef typename  tr::DesInDataMag	DesInDataMag;
 	typedef typename  tr::DesOutDataMag	DesOutDataMag;
@@ -121,34 +348,31 @@ struct OFBasedDescriptorMagnitude : public OFBasedDescriptorBase
 			_maxMagnitude;
 	//________________________________________________________________
 
-	void Describe(void * invoid, void *outvoid)
+	void Describe(DesInDataMag & in, DesOutDataMag & out) override
 	{
-		DesInDataMag & in	= *((DesInDataMag*)(invoid));
-		DesOutDataMag & out	= *((DesOutDataMag*)(outvoid));
-
 		double	binVelozRange	= _maxMagnitude / (float)_magnitudeBin;
-		int		cubPos			= 0;
-		for (auto & cuboid : in.second ) //for each cuboid
+		int		window			= out.beginWindow((int)in.second.size(), _magnitudeBin + 1);
+		forEachCuboid(in.second, this->_numThreads, this->_active, [&](int c) //for each cuboid
 		{
-			HistoType histogram(1, _magnitudeBin + 1);
-			histogram = histogram * 0;
+			auto & cuboid = in.second[c];
+			float *hist = out.histogram(window, c);
 			for (auto & img : in.first) // for each image
 			{
 				for (int i = cuboid.xi; i < cuboid.xf; ++i)
 				{
+					const float *mag = img[i];
 					for (int j = cuboid.yi; j < cuboid.yf; ++j)
 					{
-						if (img(i, j) > _thrMagnitude)
+						if (mag[j] > _thrMagnitude)
 						{
-							int s = (int)(img(i, j) / binVelozRange);
+							int s = (int)(mag[j] / binVelozRange);
 							if (s >= _magnitudeBin) s = _magnitudeBin;
-							histogram(0, s)++;
+							hist[s]++;
 						}
 					}
 				}
 			}
-			out[cubPos++].push_back(histogram);
-		}
+		});
 	}
 	virtual void setData(std::string file)
 	{
@@ -173,13 +397,13 @@ struct Trait_Gabor
 	typedef std::vector< cv::Mat_<float> >			VecMat;
 	typedef std::vector< VecMat >					Vec_Vec_Mat;
 	typedef std::pair< Vec_Vec_Mat, CuboTypeCont>	DesInData;	//input data type
-	typedef std::vector< HistoType >				DesOutData;//output data type
+	typedef HistogramSink							DesOutData;//output data type
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 //Simple magnitude descriptor...................................................
 template <class tr>
-struct OFBasedDescriptorGabor : public OFBasedDescriptorBase
+struct OFBasedDescriptorGabor final : public OFDescriptor<tr>
 {
 	typedef typename  tr::DesInData		DesInData;
 	typedef typename  tr::DesOutData	DesOutData;
@@ -191,61 +415,63 @@ struct OFBasedDescriptorGabor : public OFBasedDescriptorBase
 	float	_thrMagnitude,
 			  _maxMagnitude;
 	//__________________________________________________________________________
-	//invoid = vec vec mat, where vec mat is of_orientation, of_magnitude, other
+	//in	 = vec vec mat, where vec mat is of_orientation, of_magnitude, other
 	//		   mats correspond to n gabor scales................................
 	//out	 = single histogram.................................................
-	void Describe(void * invoid, void * outvoid)
+	void Describe(DesInData & in, DesOutData & out) override
 	{
-		DesInData & in		= *((DesInData*)(invoid));
-		DesOutData & out	= *((DesOutData*)(outvoid));
-
-		double	binRange		= 360 / _orientNumBin,
-				binVelozRange	= _maxMagnitude / (float)_magnitudeBin;
-		int		cubPos			= 0;
-		int		step			= _orientNumBin * (_magnitudeBin + 1);
-		for (auto & cuboid : in.second) //for each cuboid
+		dispatchFlowBins(_orientNumBin, _magnitudeBin, [&](auto bins){
+			this->describeBins(bins, in, out);
+		});
+	}
+	//__________________________________________________________________________
+	template <class Bins>
+	void describeBins(const Bins & bins, DesInData & in, DesOutData & out)
+	{
+		int		step			= bins.size();
+		std::vector< cv::Mat_<ushort> >	planes;
+		flowBinPlanes(bins, in.first, [](const typename tr::VecMat & fr){
+			return std::make_pair(fr[0], fr[1]);
+		}, _thrMagnitude, _maxMagnitude, this->_numThreads, planes);
+		int		window			= out.beginWindow((int)in.second.size(), step * _gaborNumBin);
+		forEachCuboid(in.second, this->_numThreads, this->_active, [&](int c) //for each cuboid
 		{
-			/*Mat frm(in.first[0][0].rows, in.first[0][0].cols, CV_8SC3);
-			frm = frm * 0;
-			cv::rectangle(frm,
-			cv::Point(cuboid.yi, cuboid.xi),
-			cv::Point(cuboid.yf, cuboid.xf),
-			cv::Scalar(0, 0, 255));/**/
-			HistoType histogram(1, _orientNumBin * (_magnitudeBin + 1) * _gaborNumBin);
-			histogram = histogram * 0;
-			for (auto & imgVec : in.first) // for each image
+			auto & cuboid = in.second[c];
+			float *hist = out.histogram(window, c);
+			std::vector<const float *>	rows;
+			for (size_t f = 0; f < in.first.size(); ++f) // for each image
 			{
-				
-				
+				auto & imgVec = in.first[f];
+				rows.resize(imgVec.size());
 				for (int i = cuboid.xi; i <= cuboid.xf; ++i)
 				{
+					const ushort *bin = planes[f][i];
+					for (size_t k = 2; k < imgVec.size(); ++k)
+						rows[k] = imgVec[k][i];
 					for (int j = cuboid.yi; j <= cuboid.yf; ++j)
 					{
-						if (imgVec[1](i, j) > _thrMagnitude)
+						if (bin[j] != bins.none)
 						{
-							int p = (int)(imgVec[0](i, j) / binRange);
-							int s = (int)(imgVec[1](i, j) / binVelozRange);
-							if (s >= _magnitudeBin) s = _magnitudeBin;
-							int pos_in_mat = (p * (_magnitudeBin + 1) + s);
-							
-							float	maxval = imgVec[2](i,j);
+							float	maxval = rows[2][j];
 							int		posmax = 2;
-							for (size_t k = 3; k < imgVec.size(); ++k)
+							for (size_t k = 3; k < rows.size(); ++k)
 							{
-								if (maxval < imgVec[k](i, j)){
+								if (maxval < rows[k][j]){
 									posmax = k;
-									maxval = imgVec[k](i, j);
+									maxval = rows[k][j];
 								}
 							}
-							++histogram(0, ((posmax - 2) * step) + pos_in_mat);
+							++hist[((posmax - 2) * step) + bin[j]];
 						}
 					}
 				}
 			}
-			double total = cv::sum(histogram)[0] + FLT_MIN;
-			histogram	 = histogram / total;
-			out[cubPos++].push_back(histogram);
-		}
+			double total = FLT_MIN;
+			for (int k = 0; k < out.bins(); ++k)
+				total += hist[k];
+			for (int k = 0; k < out.bins(); ++k)
+				hist[k] = (float)(hist[k] / total);
+		});
 	}
 	virtual void setData(std::string file)
 	{
@@ -259,42 +485,162 @@ struct OFBasedDescriptorGabor : public OFBasedDescriptorBase
 };/**/
 
 
+////////////////////////////////////////////////////////////////////////////////
+//trait for the joint gabor flow descriptor: each frame has its optical flow
+//(orientation, magnitude) and the per pixel argmax gabor scale
+struct Trait_GaborMap
+{
+	typedef cv::Mat_< float >								HistoType;
+	typedef std::vector< cutil_grig_point >					CuboTypeCont;
+	typedef std::pair< cv::Mat_<float>, cv::Mat_<float> >	DesparMat;
+	typedef std::pair< DesparMat, cv::Mat_<uchar> >			FrameType;
+	typedef std::pair< std::vector<FrameType>, CuboTypeCont>	DesInData;	//input data type
+	typedef HistogramSink									DesOutData;//output data type
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//Same histogram as OFBasedDescriptorGabor, but the scale of each pixel comes
+//already as an argmax map, so (scale, orientation, magnitude) are binned in a
+//single pass over the cuboid..................................................
+template <class tr>
+struct OFBasedDescriptorGaborMap final : public OFDescriptor<tr>
+{
+	typedef typename  tr::DesInData		DesInData;
+	typedef typename  tr::DesOutData	DesOutData;
+	typedef typename  tr::HistoType		HistoType;
+
+	int		_orientNumBin,
+			  _magnitudeBin,
+			  _gaborNumBin;
+	float	_thrMagnitude,
+			  _maxMagnitude;
+	//__________________________________________________________________________
+	void Describe(DesInData & in, DesOutData & out) override
+	{
+		dispatchFlowBins(_orientNumBin, _magnitudeBin, [&](auto bins){
+			this->describeBins(bins, in, out);
+		});
+	}
+	//__________________________________________________________________________
+	template <class Bins>
+	void describeBins(const Bins & bins, DesInData & in, DesOutData & out)
+	{
+		int		step			= bins.size();
+		std::vector< cv::Mat_<ushort> >	planes;
+		//a scale beyond _gaborNumBin would be counted past the histogram
+		for (auto & fr : in.first)
+		{
+			double	maxScale = 0;
+			cv::minMaxIdx(fr.second, nullptr, &maxScale);
+			CV_Assert(maxScale < _gaborNumBin);
+		}
+		flowBinPlanes(bins, in.first, [](const typename tr::FrameType & fr){ return fr.first; },
+					  _thrMagnitude, _maxMagnitude, this->_numThreads, planes);
+		int		window			= out.beginWindow((int)in.second.size(), step * _gaborNumBin);
+		forEachCuboid(in.second, this->_numThreads, this->_active, [&](int c) //for each cuboid
+		{
+			auto & cuboid = in.second[c];
+			float *hist = out.histogram(window, c);
+			for (size_t f = 0; f < in.first.size(); ++f) // for each image
+			{
+				for (int i = cuboid.xi; i <= cuboid.xf; ++i)
+				{
+					const ushort *bin	= planes[f][i];
+					const uchar *scale	= in.first[f].second[i];
+					for (int j = cuboid.yi; j <= cuboid.yf; ++j)
+						if (bin[j] != bins.none)
+							++hist[scale[j] * step + bin[j]];
+				}
+			}
+			double total = FLT_MIN;
+			for (int k = 0; k < out.bins(); ++k)
+				total += hist[k];
+			for (int k = 0; k < out.bins(); ++k)
+				hist[k] = (float)(hist[k] / total);
+		});
+	}
+	virtual void setData(std::string file)
+	{
+		cv::FileStorage fs(file, cv::FileStorage::READ);
+		fs["descriptor_orientNumBin"] >> _orientNumBin;
+		fs["descriptor_gaborNumBin"]  >> _gaborNumBin;
+		fs["descriptor_magnitudeBin"] >> _magnitudeBin;
+		fs["descriptor_maxMagnitude"] >> _maxMagnitude;
+		fs["descriptor_thrMagnitude"] >> _thrMagnitude;
+	}
+};
+
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
-double entropyOfImgRegion(cv::Mat_<float> & ori, cv::Mat_<float> & mag,
-                          float thr,  int x, int y, int size,
-                           int numbin, double binRange){
-  int posx, posy;
-  double acum = 0;
-  cv::Mat_<double> histogram(1,numbin);
-  histogram = histogram * 0;
-  for (int i = -size; i <= size; ++i){
-    for (int j = -size; j <= size; ++j){
-      posx = x + i;
-      posy = y + j;
-      if (posx >= 0 && 
-          posy >= 0 &&
-          posx < ori.rows   && 
-          posy < ori.cols ){
-        if (mag(posx, posy) > thr){
-          int bin = floor(ori(posx, posy) / binRange);
-          ++histogram(0, bin);
-        }
+//Entropy bin of every moving pixel of a frame, -1 for the others. The entropy
+//is -sum(p log p) of the orientation histogram (numbin bins of binRange) of the
+//pixels with magnitude over thr in the (2 size + 1)^2 neighborhood, clipped to
+//the frame. The orientation counts come from per-bin integral images (bins
+//interleaved, so each corner is one contiguous read), which makes a pixel
+//O(numbin) whatever the neighborhood size. With p = c / N,
+//-sum(p log p) = log N - sum(c log c) / N, so the logs come from two tables
+//indexed by counts.............................................................
+void entropyMapOfImg(const cv::Mat_<float> & ori, const cv::Mat_<float> & mag,
+                     float thr, int size, int numbin, double binRange,
+                     double entropyRange, cv::Mat_<int> & out)
+{
+  int rows  = ori.rows,
+      cols  = ori.cols,
+      icols = cols + 1,
+      area  = (2 * size + 1) * (2 * size + 1);
+  std::vector<int>    integral((size_t)(rows + 1) * icols * numbin, 0);
+  std::vector<double> logN(area + 1, 0), clogc(area + 1, 0);
+  for (int c = 1; c <= area; ++c){
+    logN[c]  = log((double)c);
+    clogc[c] = c * logN[c];
+  }
+  //integral(i, j, k) = moving pixels of bin k above and left of (i, j)
+  std::vector<int> rowsum(numbin);
+  for (int i = 0; i < rows; ++i){
+    const float *o = ori[i], *m = mag[i];
+    const int   *up  = &integral[((size_t)i * icols) * numbin];
+    int         *cur = &integral[((size_t)(i + 1) * icols) * numbin];
+    std::fill(rowsum.begin(), rowsum.end(), 0);
+    for (int j = 0; j < cols; ++j){
+      if (m[j] > thr)
+        ++rowsum[(std::min)((int)floor(o[j] / binRange), numbin - 1)];
+      for (int k = 0; k < numbin; ++k)
+        cur[(j + 1) * numbin + k] = up[(j + 1) * numbin + k] + rowsum[k];
+    }
+  }
+  out.create(rows, cols);
+  for (int i = 0; i < rows; ++i){
+    const float *m = mag[i];
+    int         *e = out[i];
+    int         r0 = (std::max)(i - size, 0),
+                r1 = (std::min)(i + size, rows - 1) + 1;
+    for (int j = 0; j < cols; ++j){
+      e[j] = -1;
+      if (m[j] <= thr)
+        continue;
+      int c0 = (std::max)(j - size, 0),
+          c1 = (std::min)(j + size, cols - 1) + 1;
+      const int *a = &integral[((size_t)r1 * icols + c1) * numbin],
+                *b = &integral[((size_t)r0 * icols + c1) * numbin],
+                *c = &integral[((size_t)r1 * icols + c0) * numbin],
+                *d = &integral[((size_t)r0 * icols + c0) * numbin];
+      int     total = 0;
+      double  acum  = 0;
+      for (int k = 0; k < numbin; ++k){
+        int count = a[k] - b[k] - c[k] + d[k];
+        total += count;
+        acum  += clogc[count];
       }
+      e[j] = (int)((logN[total] - acum / total) / entropyRange);
     }
   }
-  histogram = histogram / sum(histogram)[0] + FLT_MIN;
-  for (int i = 0; i < histogram.cols; ++i)
-    acum += histogram(0, i) * log(histogram(0, i));
-  return -acum;
 }
 ////////////////////////////////////////////////////////////////////////////////
 //Entropy descriptor using magnitude orientation................................ 
-//the main idea is taking acount the orientation 
-//entropy neeigborhood of a pixel (x,y) 
 template <class tr>
-struct OFBasedDescriptorEntropyMO : public OFBasedDescriptorBase
+struct OFBasedDescriptorEntropyMO final : public OFDescriptor<tr>
 {
 	typedef typename  tr::DesInData		DesInData;
 	typedef typename  tr::DesOutData	DesOutData;
@@ -309,58 +655,57 @@ struct OFBasedDescriptorEntropyMO : public OFBasedDescriptorBase
         base_;
 	//______________________________________________________________
 	
-	virtual void Describe(void * invoid, void *outvoid)
+	void Describe(DesInData & in, DesOutData & out) override
 	{
-
-		DesInData & in		= *((DesInData*)(invoid));
-		DesOutData & out	= *((DesOutData*)(outvoid));
-
-		double	binRange		  = 360 / _orientNumBin,
-				    binVelozRange	= _maxMagnitude / (float)_magnitudeBin,
-            maxEntropy    = log2(_orientNumBin),
+		dispatchFlowBins(_orientNumBin, _magnitudeBin, [&](auto bins){
+			this->describeBins(bins, in, out);
+		});
+	}
+	//______________________________________________________________
+	template <class Bins>
+	void describeBins(const Bins & bins, DesInData & in, DesOutData & out)
+	{
+		double	binRange		  = bins.orientRange(),
+            maxEntropy    = log2(bins.orient()),
             entropyRange  = maxEntropy / entropyBin_;
 		
-    int		  cubPos			  = 0;
+    int     step          = bins.size();
 		
-
-		for (auto & cuboid : in.second ) //for each cuboid
+		//the entropy of each pixel does not depend on the cuboid, so it is
+		//computed once per frame
+		std::vector< cv::Mat_<int> > entropyMaps(in.first.size());
+		auto entropyMap = [&](int f){
+			entropyMapOfImg(in.first[f].first, in.first[f].second, _thrMagnitude,
+				neighborTam_, bins.orient(), binRange, entropyRange, entropyMaps[f]);
+		};
+		if (this->_numThreads == 1)
+			for (int f = 0; f < (int)in.first.size(); ++f)
+				entropyMap(f);
+		else
+			supp_parallel_for((int)in.first.size(), entropyMap, this->_numThreads);
+		std::vector< cv::Mat_<ushort> >	planes;
+		flowBinPlanes(bins, in.first, [](const typename tr::DesparMat & fr){ return fr; },
+					  _thrMagnitude, _maxMagnitude, this->_numThreads, planes);
+
+		int		window			= out.beginWindow((int)in.second.size(), step * entropyBin_);
+
+		forEachCuboid(in.second, this->_numThreads, this->_active, [&](int c) //for each cuboid
 		{
 
-			HistoType histogram( 1, _orientNumBin * 
-                              (_magnitudeBin + 1) * 
-                              entropyBin_ );
-			histogram = histogram * 0;
-			for (auto & imgPair : in.first) // for each image
+			auto & cuboid = in.second[c];
+			float *hist = out.histogram(window, c);
+			for (size_t f = 0; f < in.first.size(); ++f) // for each image
 			{
-				cv::Mat frm(imgPair.second.rows,imgPair.second.cols, CV_8SC3);
-				frm = frm * 0;
-				cv::rectangle(	frm,
-					cv::Point(cuboid.yi , cuboid.xi),
-					cv::Point(cuboid.yf, cuboid.xf), 
-					cv::Scalar(0, 0, 255) );/**/
 				for (int i = cuboid.xi; i <= cuboid.xf; ++i)
 				{
+					const ushort *bin = planes[f][i];
+					const int	*ent = entropyMaps[f][i];
 					for (int j = cuboid.yi; j <= cuboid.yf; ++j)
-					{
-            if (imgPair.second(i, j) > _thrMagnitude)
-						{
-              int e = (int)(entropyOfImgRegion(imgPair.first, 
-                        imgPair.second, _thrMagnitude,
-                        i, j, neighborTam_,
-                       _orientNumBin, binRange) / entropyRange);
-							int p = (int)(imgPair.first(i, j) / binRange);
-							int s = (int)(imgPair.second(i, j) / binVelozRange);
-							if (s >= _magnitudeBin) s = _magnitudeBin;
-							//histogram(0, p*(_magnitudeBin+1) + s) += imgPair.second(i, j);
-							++histogram(0,  e* _orientNumBin * (_magnitudeBin+1)  + 
-                              p*(_magnitudeBin+1)                   + 
-                              s);
-						}
-					}
+						if (bin[j] != bins.none)
+							++hist[ent[j] * step + bin[j]];
 				}
 			}
-			out[cubPos++].push_back(histogram);
-		}
+		});
 	}
 	virtual void setData(std::string file){
 		cv::FileStorage fs(file, cv::FileStorage::READ);
@@ -377,7 +722,7 @@ struct OFBasedDescriptorEntropyMO : public OFBasedDescriptorBase
 /////////////////////////////////////////////////////////////////////
 //Classical hoof descriptor
 template <class tr>
-struct OFBasedDescriptorHoof : public OFBasedDescriptorBase
+struct OFBasedDescriptorHoof final : public OFDescriptor<tr>
 {
   typedef typename  tr::DesInData		DesInData;
 	typedef typename  tr::DesOutData	DesOutData;
@@ -385,42 +730,34 @@ struct OFBasedDescriptorHoof : public OFBasedDescriptorBase
 
   int   numbin_orient_;
 
-  virtual void Describe(void * invoid, void *outvoid)
+  void Describe(DesInData & in, DesOutData & out) override
   {
-    DesInData & in		= *((DesInData*)(invoid));
-		DesOutData & out	= *((DesOutData*)(outvoid));
-
     double  binRange = 360 / numbin_orient_;
 
-    int     cubPos   = 0;
+    int		window			= out.beginWindow((int)in.second.size(), numbin_orient_);
 
-    for (auto & cuboid : in.second ) //for each cuboid
+    forEachCuboid(in.second, this->_numThreads, this->_active, [&](int c) //for each cuboid
 		{
 
-			HistoType histogram( 1, numbin_orient_ );
-			histogram = histogram * 0;
+			auto & cuboid = in.second[c];
+			float *hist = out.histogram(window, c);
 			for (auto & imgPair : in.first) // for each image
 			{
-				/*cv::Mat frm(imgPair.second.rows,imgPair.second.cols, CV_8SC3);
-				frm = frm * 0;
-				cv::rectangle(	frm,
-					cv::Point(cuboid.yi , cuboid.xi),
-					cv::Point(cuboid.yf, cuboid.xf), 
-					cv::Scalar(0, 0, 255) );/**/
 				for (int i = cuboid.xi; i <= cuboid.xf; ++i)
 				{
+					const float *ori = imgPair.first[i],
+								*mag = imgPair.second[i];
 					for (int j = cuboid.yi; j <= cuboid.yf; ++j)
 					{
-            if (imgPair.second(i, j) > 0.5)
+            if (mag[j] > 0.5)
 						{
-							int p = (int)(imgPair.first(i, j) / binRange);
-							histogram(0, p) += imgPair.second(i, j);
+							int p = (int)(ori[j] / binRange);
+							hist[p] += mag[j];
 						}
 					}
 				}
 			}
-			out[cubPos++].push_back(histogram);
-		}
+		});
   }
 
   virtual void setData(std::string file){
@@ -431,35 +768,55 @@ struct OFBasedDescriptorHoof : public OFBasedDescriptorBase
 
 /////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////
-//Control descriptor funtion.........................................
-OFBasedDescriptorBase * selectChildDes(short opt, std::string file)
+//Descriptor options that take each input trait. Any other option gives
+//null, so a descriptor type that does not match the data is refused
+//instead of reading the input as another type........................
+template <class tr>
+OFDescriptor<tr> * createChildDes(short opt)
+{
+	return nullptr;
+}
+template <>
+OFDescriptor<Trait_OM> * createChildDes<Trait_OM>(short opt)
 {
-	OFBasedDescriptorBase *  res = nullptr;
 	switch (opt)
 	{
-		case 1:{
-			res = new OFBasedDescriptorMO<Trait_OM>;
-			break;
-		}
-		case 2:{
-			res = new OFBasedDescriptorGabor<Trait_Gabor>;
-			break;
-		}
-		case 3:{
-			res = new OFBasedDescriptorMagnitude<Trait_M>;
-			break;
-		}
-    case 4:{
-			res = new OFBasedDescriptorEntropyMO<Trait_OM>;
-			break;
-		}
-    case 5:{
-			res = new OFBasedDescriptorHoof<Trait_OM>;
-			break;
-		}
-		default:{}
+		case 1: return new OFBasedDescriptorMO<Trait_OM>;
+		case 4: return new OFBasedDescriptorEntropyMO<Trait_OM>;
+		case 5: return new OFBasedDescriptorHoof<Trait_OM>;
+		default: return nullptr;
+	}
+}
+template <>
+OFDescriptor<Trait_M> * createChildDes<Trait_M>(short opt)
+{
+	return opt == 3 ? new OFBasedDescriptorMagnitude<Trait_M> : nullptr;
+}
+template <>
+OFDescriptor<Trait_Gabor> * createChildDes<Trait_Gabor>(short opt)
+{
+	return opt == 2 ? new OFBasedDescriptorGabor<Trait_Gabor> : nullptr;
+}
+template <>
+OFDescriptor<Trait_GaborMap> * createChildDes<Trait_GaborMap>(short opt)
+{
+	return opt == 6 ? new OFBasedDescriptorGaborMap<Trait_GaborMap> : nullptr;
+}
+/////////////////////////////////////////////////////////////////////
+//Control descriptor funtion.........................................
+template <class tr>
+OFDescriptor<tr> * selectChildDes(short opt, std::string file)
+{
+	OFDescriptor<tr> *  res = createChildDes<tr>(opt);
+	if(res){
+		res->setData(file);
+		//serial unless the file asks for workers, older files have no key
+		cv::FileStorage fs(file, cv::FileStorage::READ);
+		if (!fs["descriptor_numThreads"].empty())
+			fs["descriptor_numThreads"] >> res->_numThreads;
 	}
-	if(res) res->setData(file);
+	else	std::cout << "descriptor type " << opt 
+						<< " does not take this input data" << std::endl;
 	return res;
 }
 
@@ -22,6 +22,297 @@ static const unsigned char   SIGNATURE_TGA_UNCOMPRESSED[12] = {0, 0, 2, 0, 0, 0,
 static const unsigned char   SIGNATURE_TGA_COMPRESSED[12] = {0, 0, 10, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 static const unsigned char   SIGNATURE_TGA_UNCOMPRESSED8BIT[12] = {0, 1, 1, 0, 0, 0, 1, 24, 0, 0, 0, 0};
 
+///////////////////////////////////////////////////////////////////////
+// Fast paths for 8 bits per channel: 8 bpp grayscale with linear palette,
+// 24 and 32 bpp. Channels are interleaved bytes filtered independently, so a
+// row is processed as a plain byte array. Sums are accumulated in the same
+// order as the generic code and truncated the same way: results are identical.
+///////////////////////////////////////////////////////////////////////
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define GCG_IMAGE_SSE2
+#endif
+
+// Minimum number of rows per band given to gcgParallelRows()
+#define GCG_IMAGE_MINROWS 16
+
+// Arguments of the row kernels
+typedef struct _GCG_IMAGEFILTER8 {
+  const unsigned char *src, *src2;          // Sources: src2 used only by combineAdd()
+  unsigned char       *dst;
+  unsigned int        srcrowsize, src2rowsize, dstrowsize;
+  unsigned int        width, height;        // In pixels
+  unsigned int        channels;             // Bytes per pixel: 1, 3 or 4
+  unsigned int        dstchannels;          // Bytes per destination pixel (grayscale conversion)
+  const float         *mask;                // Row major mask
+  int                 maskwidth, maskheight, originX, originY;
+  float               weight1, weight2, addthis;
+} GCG_IMAGEFILTER8;
+
+static inline unsigned char clampByte(float sum) {
+  return (sum < 0.0) ? 0 : ((sum > 255.0) ? 255 : (unsigned char) sum);
+}
+
+static inline int reflectIndex(int j, int size) {
+  return (j < 0) ? -j : ((j < size) ? j : size + size - j - 2);
+}
+
+#ifdef GCG_IMAGE_SSE2
+// Converts 16 bytes to 4 vectors of floats
+static inline void load16Bytes(const unsigned char *p, __m128 f[4]) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i b  = _mm_loadu_si128((const __m128i*) p);
+  __m128i lo = _mm_unpacklo_epi8(b, zero), hi = _mm_unpackhi_epi8(b, zero);
+  f[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+  f[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+  f[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+  f[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+}
+
+// Clamps 4 vectors of floats to [0, 255] and stores them truncated as 16 bytes
+static inline void store16Bytes(unsigned char *p, const __m128 f[4]) {
+  __m128 zero = _mm_setzero_ps(), top = _mm_set1_ps(255.0f);
+  __m128i i0 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(f[0], zero), top));
+  __m128i i1 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(f[1], zero), top));
+  __m128i i2 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(f[2], zero), top));
+  __m128i i3 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(f[3], zero), top));
+  _mm_storeu_si128((__m128i*) p, _mm_packus_epi16(_mm_packs_epi32(i0, i1), _mm_packs_epi32(i2, i3)));
+}
+
+// sum += m * x for 16 bytes
+static inline void madd16Bytes(__m128 sum[4], float m, const unsigned char *p) {
+  __m128 x[4], vm = _mm_set1_ps(m);
+  load16Bytes(p, x);
+  sum[0] = _mm_add_ps(sum[0], _mm_mul_ps(vm, x[0]));
+  sum[1] = _mm_add_ps(sum[1], _mm_mul_ps(vm, x[1]));
+  sum[2] = _mm_add_ps(sum[2], _mm_mul_ps(vm, x[2]));
+  sum[3] = _mm_add_ps(sum[3], _mm_mul_ps(vm, x[3]));
+}
+#endif
+
+// Convolution along rows: reflected borders are computed apart from the interior
+static void convolutionRowsX8(void *args, unsigned int firstrow, unsigned int lastrow) {
+  GCG_IMAGEFILTER8 *f = (GCG_IMAGEFILTER8*) args;
+  const int width = (int) f->width, channels = (int) f->channels, length = f->maskwidth, origin = f->originX;
+  const float *mask = f->mask;
+
+  // Pixels in [first, last) have all taps inside the row
+  int first = MIN(origin, width);
+  int last = MIN(width, MAX(first, width - length + origin + 1));
+
+  for(unsigned int row = firstrow; row < lastrow; row++) {
+    const unsigned char *srcrow = &f->src[row * f->srcrowsize];
+    unsigned char *dstrow = &f->dst[row * f->dstrowsize];
+
+    // Borders
+    for(int i = 0; i < width; i++) {
+      if(i == first) i = last;
+      if(i >= width) break;
+      for(int c = 0; c < channels; c++) {
+        register float sum = f->addthis;
+        register int j = i - origin;
+        for(register int pos = 0; pos < length; j++, pos++)
+          sum += mask[pos] * srcrow[reflectIndex(j, width) * channels + c];
+        dstrow[i * channels + c] = clampByte(sum);
+      }
+    }
+
+    // Interior
+    const unsigned char *taps = &srcrow[-origin * channels];
+    int b = first * channels, end = last * channels;
+#ifdef GCG_IMAGE_SSE2
+    for(; b + 16 <= end; b += 16) {
+      __m128 sum[4];
+      sum[0] = sum[1] = sum[2] = sum[3] = _mm_set1_ps(f->addthis);
+      for(int pos = 0; pos < length; pos++) madd16Bytes(sum, mask[pos], &taps[b + pos * channels]);
+      store16Bytes(&dstrow[b], sum);
+    }
+#endif
+    for(; b < end; b++) {
+      register float sum = f->addthis;
+      for(register int pos = 0; pos < length; pos++) sum += mask[pos] * taps[b + pos * channels];
+      dstrow[b] = clampByte(sum);
+    }
+  }
+}
+
+// Convolution along columns: reflected rows are resolved once per output row
+static void convolutionRowsY8(void *args, unsigned int firstrow, unsigned int lastrow) {
+  GCG_IMAGEFILTER8 *f = (GCG_IMAGEFILTER8*) args;
+  const int length = f->maskheight, rowbytes = (int) (f->width * f->channels);
+  const float *mask = f->mask;
+
+  const unsigned char *localrows[32];
+  const unsigned char **srcrows = (length <= 32) ? localrows : new const unsigned char*[length];
+
+  for(unsigned int row = firstrow; row < lastrow; row++) {
+    unsigned char *dstrow = &f->dst[row * f->dstrowsize];
+    for(int pos = 0, j = (int) row - f->originY; pos < length; pos++, j++)
+      srcrows[pos] = &f->src[reflectIndex(j, (int) f->height) * f->srcrowsize];
+
+    int b = 0;
+#ifdef GCG_IMAGE_SSE2
+    for(; b + 16 <= rowbytes; b += 16) {
+      __m128 sum[4];
+      sum[0] = sum[1] = sum[2] = sum[3] = _mm_set1_ps(f->addthis);
+      for(int pos = 0; pos < length; pos++) madd16Bytes(sum, mask[pos], &srcrows[pos][b]);
+      store16Bytes(&dstrow[b], sum);
+    }
+#endif
+    for(; b < rowbytes; b++) {
+      register float sum = f->addthis;
+      for(register int pos = 0; pos < length; pos++) sum += mask[pos] * srcrows[pos][b];
+      dstrow[b] = clampByte(sum);
+    }
+  }
+
+  if(srcrows != localrows) delete[] srcrows;
+}
+
+// 2D convolution: combines the row resolution of Y with the border split of X
+static void convolutionRowsXY8(void *args, unsigned int firstrow, unsigned int lastrow) {
+  GCG_IMAGEFILTER8 *f = (GCG_IMAGEFILTER8*) args;
+  const int width = (int) f->width, channels = (int) f->channels;
+  const int mwidth = f->maskwidth, mheight = f->maskheight, origin = f->originX;
+
+  int first = MIN(origin, width);
+  int last = MIN(width, MAX(first, width - mwidth + origin + 1));
+
+  const unsigned char *localrows[32];
+  const unsigned char **srcrows = (mheight <= 32) ? localrows : new const unsigned char*[mheight];
+
+  for(unsigned int row = firstrow; row < lastrow; row++) {
+    unsigned char *dstrow = &f->dst[row * f->dstrowsize];
+    for(int posY = 0, j = (int) row - f->originY; posY < mheight; posY++, j++)
+      srcrows[posY] = &f->src[reflectIndex(j, (int) f->height) * f->srcrowsize];
+
+    // Borders
+    for(int i = 0; i < width; i++) {
+      if(i == first) i = last;
+      if(i >= width) break;
+      for(int c = 0; c < channels; c++) {
+        register float sum = f->addthis;
+        for(int posY = 0; posY < mheight; posY++) {
+          const float *maskrow = &f->mask[posY * mwidth];
+          register int j = i - origin;
+          for(register int posX = 0; posX < mwidth; j++, posX++)
+            sum += maskrow[posX] * srcrows[posY][reflectIndex(j, width) * channels + c];
+        }
+        dstrow[i * channels + c] = clampByte(sum);
+      }
+    }
+
+    // Interior
+    int b = first * channels, end = last * channels, shift = -origin * channels;
+#ifdef GCG_IMAGE_SSE2
+    for(; b + 16 <= end; b += 16) {
+      __m128 sum[4];
+      sum[0] = sum[1] = sum[2] = sum[3] = _mm_set1_ps(f->addthis);
+      for(int posY = 0; posY < mheight; posY++) {
+        const float *maskrow = &f->mask[posY * mwidth];
+        const unsigned char *taps = &srcrows[posY][b + shift];
+        for(int posX = 0; posX < mwidth; posX++) madd16Bytes(sum, maskrow[posX], &taps[posX * channels]);
+      }
+      store16Bytes(&dstrow[b], sum);
+    }
+#endif
+    for(; b < end; b++) {
+      register float sum = f->addthis;
+      for(int posY = 0; posY < mheight; posY++) {
+        const float *maskrow = &f->mask[posY * mwidth];
+        const unsigned char *taps = &srcrows[posY][b + shift];
+        for(register int posX = 0; posX < mwidth; posX++) sum += maskrow[posX] * taps[posX * channels];
+      }
+      dstrow[b] = clampByte(sum);
+    }
+  }
+
+  if(srcrows != localrows) delete[] srcrows;
+}
+
+// addthis + weight1 * src [+ weight2 * src2]: used by scale() and combineAdd()
+static void combineRows8(void *args, unsigned int firstrow, unsigned int lastrow) {
+  GCG_IMAGEFILTER8 *f = (GCG_IMAGEFILTER8*) args;
+  const int rowbytes = (int) (f->width * f->channels);
+
+  for(unsigned int row = firstrow; row < lastrow; row++) {
+    const unsigned char *srcrow1 = &f->src[row * f->srcrowsize];
+    const unsigned char *srcrow2 = (f->src2 != NULL) ? &f->src2[row * f->src2rowsize] : NULL;
+    unsigned char *dstrow = &f->dst[row * f->dstrowsize];
+
+    int b = 0;
+#ifdef GCG_IMAGE_SSE2
+    for(; b + 16 <= rowbytes; b += 16) {
+      __m128 sum[4];
+      sum[0] = sum[1] = sum[2] = sum[3] = _mm_set1_ps(f->addthis);
+      madd16Bytes(sum, f->weight1, &srcrow1[b]);
+      if(srcrow2 != NULL) madd16Bytes(sum, f->weight2, &srcrow2[b]);
+      store16Bytes(&dstrow[b], sum);
+    }
+#endif
+    if(srcrow2 != NULL)
+      for(; b < rowbytes; b++) dstrow[b] = clampByte(f->addthis + f->weight1 * (float) srcrow1[b] + f->weight2 * (float) srcrow2[b]);
+    else
+      for(; b < rowbytes; b++) dstrow[b] = clampByte(f->addthis + f->weight1 * (float) srcrow1[b]);
+  }
+}
+
+// Gray is the mean of red, green and blue. The destination has 1 byte per pixel or
+// the same layout of the source, with the alpha channel copied.
+static void grayScaleRows8(void *args, unsigned int firstrow, unsigned int lastrow) {
+  GCG_IMAGEFILTER8 *f = (GCG_IMAGEFILTER8*) args;
+  const unsigned int channels = f->channels, dstchannels = f->dstchannels;
+
+  for(unsigned int row = firstrow; row < lastrow; row++) {
+    const unsigned char *srcdata = &f->src[row * f->srcrowsize];
+    unsigned char *dstdata = &f->dst[row * f->dstrowsize];
+    unsigned int i = 0;
+
+#ifdef GCG_IMAGE_SSE2
+    if(channels == 4) {
+      // 4 pixels at once. (sum * 21846) >> 16 is sum / 3 for any sum up to 765.
+      __m128i bytemask = _mm_set1_epi32(0xff), alphamask = _mm_set1_epi32((int) 0xff000000), third = _mm_set1_epi32(21846);
+      for(; i + 4 <= f->width; i += 4, srcdata += 16, dstdata += 4 * dstchannels) {
+        __m128i p = _mm_loadu_si128((const __m128i*) srcdata);
+        __m128i sum = _mm_add_epi32(_mm_and_si128(p, bytemask),
+                      _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(p, 8), bytemask), _mm_and_si128(_mm_srli_epi32(p, 16), bytemask)));
+        __m128i gray = _mm_mulhi_epu16(sum, third);
+        if(dstchannels == 4) {
+          __m128i res = _mm_or_si128(_mm_or_si128(gray, _mm_slli_epi32(gray, 8)), _mm_or_si128(_mm_slli_epi32(gray, 16), _mm_and_si128(p, alphamask)));
+          _mm_storeu_si128((__m128i*) dstdata, res);
+        } else {
+          __m128i packed = _mm_packus_epi16(_mm_packs_epi32(gray, gray), gray);
+          int bytes = _mm_cvtsi128_si32(packed);
+          memcpy(dstdata, &bytes, 4);
+        }
+      }
+    }
+#endif
+    for(; i < f->width; i++, srcdata += channels, dstdata += dstchannels) {
+      unsigned char gray = (unsigned char) ((srcdata[0] + srcdata[1] + srcdata[2]) / 3);
+      dstdata[0] = gray;
+      if(dstchannels > 1) {
+        dstdata[1] = dstdata[2] = gray;
+        if(dstchannels == 4) dstdata[3] = srcdata[3];  // Copy alpha channel
+      }
+    }
+  }
+}
+
+// Sets the common arguments of the row kernels
+static void setFilter8(GCG_IMAGEFILTER8 *f, gcgIMAGE *src, unsigned char *dstdata, unsigned int dstrowsize, float addthis) {
+  memset(f, 0, sizeof(GCG_IMAGEFILTER8));
+  f->src = src->data;
+  f->srcrowsize = src->rowsize;
+  f->dst = dstdata;
+  f->dstrowsize = dstrowsize;
+  f->width = src->width;
+  f->height = src->height;
+  f->channels = f->dstchannels = src->bpp / 8;
+  f->addthis = addthis;
+}
+
 ///////////////////////////////////////////////////////////////////////
 
 gcgIMAGE::gcgIMAGE() {
@@ -1416,23 +1707,33 @@ bool gcgIMAGE::convolutionX(gcgIMAGE *src, gcgDISCRETE1D<float> *mask, float add
       int rshift;
       addthis *= bitmask;
 
-    	// Convolution with colors with less than 9 bits in data buffer
-      unsigned char *srcrow = src->data;
-    	for(unsigned int row = 0; row < src->height; row++, srcrow += src->rowsize) {
-        unsigned char *dstrow = &dstdata[row * rowsize];
-    		for(unsigned int i = 0; i < width; i++) {
-    		  register float sum = addthis;
-          register int j = i - (int) mask->origin;
-          for(register unsigned int pos = 0; pos < mask->length; j++, pos++) {
-            register int k = (j < 0) ? -j : ((j < (int) width) ? j : (int) width + (int) width - j - 2);
-            sum += mask->data[pos] * ((srcrow[k / pixelsperbyte] >> ((k % pixelsperbyte) * bpp)) & bitmask);
-          }
+      if(src->bpp == 8) {
+        // One index per byte: filtered as a plain 8 bits channel
+        GCG_IMAGEFILTER8 filter;
+        setFilter8(&filter, src, dstdata, rowsize, addthis);
+        filter.mask = mask->data;
+        filter.maskwidth = (int) mask->length;
+        filter.originX = (int) mask->origin;
+        gcgParallelRows(convolutionRowsX8, &filter, src->height, GCG_IMAGE_MINROWS);
+      } else {
+      	// Convolution with colors with less than 9 bits in data buffer
+        unsigned char *srcrow = src->data;
+      	for(unsigned int row = 0; row < src->height; row++, srcrow += src->rowsize) {
+          unsigned char *dstrow = &dstdata[row * rowsize];
+      		for(unsigned int i = 0; i < width; i++) {
+      		  register float sum = addthis;
+            register int j = i - (int) mask->origin;
+            for(register unsigned int pos = 0; pos < mask->length; j++, pos++) {
+              register int k = (j < 0) ? -j : ((j < (int) width) ? j : (int) width + (int) width - j - 2);
+              sum += mask->data[pos] * ((srcrow[k / pixelsperbyte] >> ((k % pixelsperbyte) * bpp)) & bitmask);
+            }
 
-          // Check bounds
-          unsigned char *ind = &dstrow[i / pixelsperbyte], val = (unsigned char) ((sum < 0.0) ? 0 : ((sum > bitmask) ? bitmask : sum));
-          rshift = (i % pixelsperbyte) * bpp;
-          *ind = (*ind ^ (*ind & (bitmask << rshift))) | ((val & bitmask) << rshift);
-    		}
+            // Check bounds
+            unsigned char *ind = &dstrow[i / pixelsperbyte], val = (unsigned char) ((sum < 0.0) ? 0 : ((sum > bitmask) ? bitmask : sum));
+            rshift = (i % pixelsperbyte) * bpp;
+            *ind = (*ind ^ (*ind & (bitmask << rshift))) | ((val & bitmask) << rshift);
+      		}
+        }
       }
 
       // Commit filtered data
@@ -1524,56 +1825,15 @@ bool gcgIMAGE::convolutionX(gcgIMAGE *src, gcgDISCRETE1D<float> *mask, float add
       }
     }
 
-    if(src->bpp == 24) {
-      addthis *= 255.0; // 8 bits/channel
-
-    	// Convolution with 24bits colors in data buffer
-      unsigned char *srcrow = src->data;
-    	for(unsigned int row = 0; row < height; row++, srcrow += rowsize) {
-        unsigned char *dstrow = &dstdata[row * rowsize];
-    		for(unsigned int i = 0; i < width; i++, dstrow += 3) {
-    		  register float sumR = addthis, sumG = addthis, sumB = addthis;
-          register int j = i - (int) mask->origin;
-          for(register unsigned int pos = 0; pos < mask->length; j++, pos++) {
-            register int k = (j < 0) ? -j : ((j < (int) width) ? j : (int) width + (int) width - j - 2);
-            sumR += mask->data[pos] * srcrow[3 * k + 0];
-            sumG += mask->data[pos] * srcrow[3 * k + 1];
-            sumB += mask->data[pos] * srcrow[3 * k + 2];
-          }
-
-          // Check bounds
-          dstrow[0] = (sumR < 0.0) ? 0 : ((sumR > 255.0) ? 255 : (unsigned char) sumR);
-          dstrow[1] = (sumG < 0.0) ? 0 : ((sumG > 255.0) ? 255 : (unsigned char) sumG);
-          dstrow[2] = (sumB < 0.0) ? 0 : ((sumB > 255.0) ? 255 : (unsigned char) sumB);
-    		}
-      }
+    if(src->bpp == 24 || src->bpp == 32) {
+      // 8 bits/channel
+      GCG_IMAGEFILTER8 filter;
+      setFilter8(&filter, src, dstdata, rowsize, addthis * 255.0f);
+      filter.mask = mask->data;
+      filter.maskwidth = (int) mask->length;
+      filter.originX = (int) mask->origin;
+      gcgParallelRows(convolutionRowsX8, &filter, height, GCG_IMAGE_MINROWS);
     } else
-      	if(src->bpp == 32) {
-      	  addthis *= 255.0; // 8 bits/channel
-
-          // Convolution with 32 bits colors in data buffer
-          unsigned char *srcrow = src->data;
-          for(unsigned int row = 0; row < height; row++, srcrow += rowsize) {
-            unsigned char *dstrow = &dstdata[row * rowsize];
-            for(unsigned int i = 0; i < width; i++, dstrow += 4) {
-              register float sumR = addthis, sumG = addthis, sumB = addthis, sumA = addthis;
-              register int j = i - (int) mask->origin;
-              for(register unsigned int pos = 0; pos < mask->length; j++, pos++) {
-                register int k = (j < 0) ? -j : ((j < (int) width) ? j : (int) width + (int) width - j - 2);
-                sumR += mask->data[pos] * srcrow[(k << 2) + 0];
-                sumG += mask->data[pos] * srcrow[(k << 2) + 1];
-                sumB += mask->data[pos] * srcrow[(k << 2) + 2];
-                sumA += mask->data[pos] * srcrow[(k << 2) + 3];
-              }
-
-              // Check bounds
-              dstrow[0] = (sumR < 0.0) ? 0 : ((sumR > 255.0) ? 255 : (unsigned char) sumR);
-              dstrow[1] = (sumG < 0.0) ? 0 : ((sumG > 255.0) ? 255 : (unsigned char) sumG);
-              dstrow[2] = (sumB < 0.0) ? 0 : ((sumB > 255.0) ? 255 : (unsigned char) sumB);
-              dstrow[3] = (sumA < 0.0) ? 0 : ((sumA > 255.0) ? 255 : (unsigned char) sumA);
-            }
-          }
-        } else
           if(src->bpp == 16) {
               // Convolution with 16 bits colors in data buffer
               float addthisR = addthis * max[0];
@@ -1671,22 +1931,32 @@ bool gcgIMAGE::convolutionY(gcgIMAGE *src, gcgDISCRETE1D<float> *mask, float add
       int rshift;
       addthis *= bitmask;
 
-    	// Convolution with colors with less than 9 bits in data buffer
-    	for(unsigned int row = 0; row < src->height; row++) {
-        unsigned char *dstrow = &dstdata[row * rowsize];
-    		for(unsigned int i = 0; i < width; i++) {
-    		  register float sum = addthis;
-          register int j = row - (int) mask->origin;
-          for(register unsigned int pos = 0; pos < mask->length; j++, pos++) {
-            register int k = (j < 0) ? -j : ((j < (int) height) ? j : (int) height + (int) height - j - 2);
-            sum += mask->data[pos] * ((src->data[k * src->rowsize + i / pixelsperbyte] >> ((i % pixelsperbyte) * src->bpp)) & bitmask);
-          }
+      if(src->bpp == 8) {
+        // One index per byte: filtered as a plain 8 bits channel
+        GCG_IMAGEFILTER8 filter;
+        setFilter8(&filter, src, dstdata, rowsize, addthis);
+        filter.mask = mask->data;
+        filter.maskheight = (int) mask->length;
+        filter.originY = (int) mask->origin;
+        gcgParallelRows(convolutionRowsY8, &filter, src->height, GCG_IMAGE_MINROWS);
+      } else {
+      	// Convolution with colors with less than 9 bits in data buffer
+      	for(unsigned int row = 0; row < src->height; row++) {
+          unsigned char *dstrow = &dstdata[row * rowsize];
+      		for(unsigned int i = 0; i < width; i++) {
+      		  register float sum = addthis;
+            register int j = row - (int) mask->origin;
+            for(register unsigned int pos = 0; pos < mask->length; j++, pos++) {
+              register int k = (j < 0) ? -j : ((j < (int) height) ? j : (int) height + (int) height - j - 2);
+              sum += mask->data[pos] * ((src->data[k * src->rowsize + i / pixelsperbyte] >> ((i % pixelsperbyte) * src->bpp)) & bitmask);
+            }
 
-          // Check bounds
-          unsigned char *ind = &dstrow[i / pixelsperbyte], val = (unsigned char) ((sum < 0.0) ? 0 : ((sum > bitmask) ? bitmask : sum));
-          rshift = (i % pixelsperbyte) * bpp;
-          *ind = (*ind ^ (*ind & (bitmask << rshift))) | ((val & bitmask) << rshift);
-    		}
+            // Check bounds
+            unsigned char *ind = &dstrow[i / pixelsperbyte], val = (unsigned char) ((sum < 0.0) ? 0 : ((sum > bitmask) ? bitmask : sum));
+            rshift = (i % pixelsperbyte) * bpp;
+            *ind = (*ind ^ (*ind & (bitmask << rshift))) | ((val & bitmask) << rshift);
+      		}
+        }
       }
 
       // Commit filtered data
@@ -1777,56 +2047,15 @@ bool gcgIMAGE::convolutionY(gcgIMAGE *src, gcgDISCRETE1D<float> *mask, float add
       }
     }
 
-    if(src->bpp == 24) {
-      addthis *= 255.0; // 8 bits/channel
-
-    	// Convolution with 24bits colors in data buffer
-    	for(unsigned int row = 0; row < height; row++) {
-        unsigned char *dstrow = &dstdata[row * rowsize];
-    		for(unsigned int i = 0; i < width; i++, dstrow += 3) {
-    		  register float sumR = addthis, sumG = addthis, sumB = addthis;
-          register int j = row - (int) mask->origin;
-          for(register unsigned int pos = 0; pos < mask->length; j++, pos++) {
-            register int k = (j < 0) ? -j : ((j < (int) height) ? j : (int) height + (int) height - j - 2);
-            register unsigned char *color = &src->data[rowsize * k + i * 3];
-            sumR += mask->data[pos] * color[0];
-            sumG += mask->data[pos] * color[1];
-            sumB += mask->data[pos] * color[2];
-          }
-
-          // Check bounds
-          dstrow[0] = (sumR < 0.0) ? 0 : ((sumR > 255.0) ? 255 : (unsigned char) sumR);
-          dstrow[1] = (sumG < 0.0) ? 0 : ((sumG > 255.0) ? 255 : (unsigned char) sumG);
-          dstrow[2] = (sumB < 0.0) ? 0 : ((sumB > 255.0) ? 255 : (unsigned char) sumB);
-    		}
-      }
+    if(src->bpp == 24 || src->bpp == 32) {
+      // 8 bits/channel
+      GCG_IMAGEFILTER8 filter;
+      setFilter8(&filter, src, dstdata, rowsize, addthis * 255.0f);
+      filter.mask = mask->data;
+      filter.maskheight = (int) mask->length;
+      filter.originY = (int) mask->origin;
+      gcgParallelRows(convolutionRowsY8, &filter, height, GCG_IMAGE_MINROWS);
     } else
-      	if(src->bpp == 32) {
-      	  addthis *= 255.0; // 8 bits/channel
-
-          // Convolution with 32 bits colors in data buffer
-          for(unsigned int row = 0; row < height; row++) {
-            unsigned char *dstrow = &dstdata[row * rowsize];
-            for(unsigned int i = 0; i < width; i++, dstrow += 4) {
-              register float sumR = addthis, sumG = addthis, sumB = addthis, sumA = addthis;
-              register int j = row - (int) mask->origin;
-              for(register unsigned int pos = 0; pos < mask->length; j++, pos++) {
-                register int k = (j < 0) ? -j : ((j < (int) height) ? j : (int) height + (int) height - j - 2);
-                register unsigned char *color = &src->data[k * rowsize + (i << 2)];
-                sumR += mask->data[pos] * color[0];
-                sumG += mask->data[pos] * color[1];
-                sumB += mask->data[pos] * color[2];
-                sumA += mask->data[pos] * color[3];
-              }
-
-              // Check bounds
-              dstrow[0] = (sumR < 0.0) ? 0 : ((sumR > 255.0) ? 255 : (unsigned char) sumR);
-              dstrow[1] = (sumG < 0.0) ? 0 : ((sumG > 255.0) ? 255 : (unsigned char) sumG);
-              dstrow[2] = (sumB < 0.0) ? 0 : ((sumB > 255.0) ? 255 : (unsigned char) sumB);
-              dstrow[3] = (sumA < 0.0) ? 0 : ((sumA > 255.0) ? 255 : (unsigned char) sumA);
-            }
-          }
-        } else
           if(src->bpp == 16) {
               // Convolution with 16 bits colors in data buffer
               float addthisR = addthis * max[0];
@@ -1920,28 +2149,40 @@ bool gcgIMAGE::convolutionXY(gcgIMAGE *src, gcgDISCRETE2D<float> *mask, float ad
       src->forceLinearPalette(); // Needed to assure the bitmap can be filtered directly
       addthis *= bitmask;
 
-    	// Convolution with colors with less than 9 bits in data buffer
-    	for(unsigned int row = 0; row < src->height; row++) {
-        unsigned char *dstrow = &dstdata[row * rowsize];
-    		for(unsigned int col = 0; col < width; col++) {
-    		  register float sum = addthis;
-          register int j = row - (int) mask->originY;
-          for(register unsigned int posY = 0; posY < mask->height; j++, posY++) {
-            register int k = (j < 0) ? -j : ((j < (int) height) ? j : (int) height + (int) height - j - 2);
-            register unsigned char *srcrow = &src->data[src->rowsize * k];
-            register float *maskrow = &mask->data[posY * mask->width];
-            register int i = col - (int) mask->originX;
-            for(register unsigned int posX = 0; posX < mask->width; i++, posX++) {
-              register int l = (i < 0) ? -i : ((i < (int) width) ? i : (int) width + (int) width - i - 2);
-              sum += maskrow[posX] * ((srcrow[l / pixelsperbyte] >> ((l % pixelsperbyte) * src->bpp)) & bitmask);
+      if(src->bpp == 8) {
+        // One index per byte: filtered as a plain 8 bits channel
+        GCG_IMAGEFILTER8 filter;
+        setFilter8(&filter, src, dstdata, rowsize, addthis);
+        filter.mask = mask->data;
+        filter.maskwidth = (int) mask->width;
+        filter.maskheight = (int) mask->height;
+        filter.originX = (int) mask->originX;
+        filter.originY = (int) mask->originY;
+        gcgParallelRows(convolutionRowsXY8, &filter, src->height, GCG_IMAGE_MINROWS);
+      } else {
+      	// Convolution with colors with less than 9 bits in data buffer
+      	for(unsigned int row = 0; row < src->height; row++) {
+          unsigned char *dstrow = &dstdata[row * rowsize];
+      		for(unsigned int col = 0; col < width; col++) {
+      		  register float sum = addthis;
+            register int j = row - (int) mask->originY;
+            for(register unsigned int posY = 0; posY < mask->height; j++, posY++) {
+              register int k = (j < 0) ? -j : ((j < (int) height) ? j : (int) height + (int) height - j - 2);
+              register unsigned char *srcrow = &src->data[src->rowsize * k];
+              register float *maskrow = &mask->data[posY * mask->width];
+              register int i = col - (int) mask->originX;
+              for(register unsigned int posX = 0; posX < mask->width; i++, posX++) {
+                register int l = (i < 0) ? -i : ((i < (int) width) ? i : (int) width + (int) width - i - 2);
+                sum += maskrow[posX] * ((srcrow[l / pixelsperbyte] >> ((l % pixelsperbyte) * src->bpp)) & bitmask);
+              }
             }
-          }
 
-          // Check bounds
-          unsigned char *ind = &dstrow[col / pixelsperbyte], val = (unsigned char) ((sum < 0.0) ? 0 : ((sum > bitmask) ? bitmask : sum));
-          int rshift = (col % pixelsperbyte) * bpp;
-          *ind = (*ind ^ (*ind & (bitmask << rshift))) | ((val & bitmask) << rshift);
-    		}
+            // Check bounds
+            unsigned char *ind = &dstrow[col / pixelsperbyte], val = (unsigned char) ((sum < 0.0) ? 0 : ((sum > bitmask) ? bitmask : sum));
+            int rshift = (col % pixelsperbyte) * bpp;
+            *ind = (*ind ^ (*ind & (bitmask << rshift))) | ((val & bitmask) << rshift);
+      		}
+        }
       }
 
       // Commit filtered data
@@ -2038,68 +2279,17 @@ bool gcgIMAGE::convolutionXY(gcgIMAGE *src, gcgDISCRETE2D<float> *mask, float ad
       }
     }
 
-    if(src->bpp == 24) {
-      addthis *= 255.0; // 8 bits/channel
-
-    	// Convolution with 24bits colors in data buffer
-    	for(unsigned int row = 0; row < height; row++) {
-        unsigned char *dstrow = &dstdata[row * rowsize];
-    		for(unsigned int col = 0; col < width; col++, dstrow += 3) {
-    		  register float sumR = addthis, sumG = addthis, sumB = addthis;
-          register int j = row - (int) mask->originY;
-          for(register unsigned int posY = 0; posY < mask->height; j++, posY++) {
-            register int k = (j < 0) ? -j : ((j < (int) height) ? j : (int) height + (int) height - j - 2);
-            register unsigned char *srcrow = &src->data[rowsize * k];
-            register float *maskrow = &mask->data[posY * mask->width];
-            register int i = col - (int) mask->originX;
-            for(register unsigned int posX = 0; posX < mask->width; i++, posX++) {
-              register int l = (i < 0) ? -i : ((i < (int) width) ? i : (int) width + (int) width - i - 2);
-              register unsigned char *color = &srcrow[l * 3];
-              sumR += maskrow[posX] * color[0];
-              sumG += maskrow[posX] * color[1];
-              sumB += maskrow[posX] * color[2];
-            }
-          }
-
-          // Check bounds
-          dstrow[0] = (sumR < 0.0) ? 0 : ((sumR > 255.0) ? 255 : (unsigned char) sumR);
-          dstrow[1] = (sumG < 0.0) ? 0 : ((sumG > 255.0) ? 255 : (unsigned char) sumG);
-          dstrow[2] = (sumB < 0.0) ? 0 : ((sumB > 255.0) ? 255 : (unsigned char) sumB);
-    		}
-      }
+    if(src->bpp == 24 || src->bpp == 32) {
+      // 8 bits/channel
+      GCG_IMAGEFILTER8 filter;
+      setFilter8(&filter, src, dstdata, rowsize, addthis * 255.0f);
+      filter.mask = mask->data;
+      filter.maskwidth = (int) mask->width;
+      filter.maskheight = (int) mask->height;
+      filter.originX = (int) mask->originX;
+      filter.originY = (int) mask->originY;
+      gcgParallelRows(convolutionRowsXY8, &filter, height, GCG_IMAGE_MINROWS);
     } else
-      	if(src->bpp == 32) {
-      	  addthis *= 255.0; // 8 bits/channel
-
-          // Convolution with 32 bits colors in data buffer
-          for(unsigned int row = 0; row < height; row++) {
-            unsigned char *dstrow = &dstdata[row * rowsize];
-            for(unsigned int col = 0; col < width; col++, dstrow += 4) {
-              register float sumR = addthis, sumG = addthis, sumB = addthis, sumA = addthis;
-              register int j = row - (int) mask->originY;
-              for(register unsigned int posY = 0; posY < mask->height; j++, posY++) {
-                register int k = (j < 0) ? -j : ((j < (int) height) ? j : (int) height + (int) height - j - 2);
-                register unsigned char *srcrow = &src->data[k * rowsize];
-                register float *maskrow = &mask->data[posY * mask->width];
-                register int i = col - (int) mask->originX;
-                for(register unsigned int posX = 0; posX < mask->width; i++, posX++) {
-                  register int l = (i < 0) ? -i : ((i < (int) width) ? i : (int) width + (int) width - i - 2);
-                  register unsigned char *color = &srcrow[l << 2];
-                  sumR += maskrow[posX] * color[0];
-                  sumG += maskrow[posX] * color[1];
-                  sumB += maskrow[posX] * color[2];
-                  sumA += maskrow[posX] * color[3];
-                }
-              }
-
-              // Check bounds
-              dstrow[0] = (sumR < 0.0) ? 0 : ((sumR > 255.0) ? 255 : (unsigned char) sumR);
-              dstrow[1] = (sumG < 0.0) ? 0 : ((sumG > 255.0) ? 255 : (unsigned char) sumG);
-              dstrow[2] = (sumB < 0.0) ? 0 : ((sumB > 255.0) ? 255 : (unsigned char) sumB);
-              dstrow[3] = (sumA < 0.0) ? 0 : ((sumA > 255.0) ? 255 : (unsigned char) sumA);
-            }
-          }
-        } else
             if(src->bpp == 16) {
               // Convolution with 16 bits colors in data buffer
               float addthisR = addthis * max[0];
@@ -2510,29 +2700,12 @@ bool gcgIMAGE::convertGrayScale(gcgIMAGE *src) {
     // Forces the palette linearity
     if(!islinear) this->forceLinearPalette();
   } else
-    if(src->bpp == 24) {
-    	// Converts 24 bpp colors in data buffer
-    	for(unsigned int row = 0; row < height; row++) {
-        unsigned char *srcdata   = &src->data[row * rowsize];
-        unsigned char *dstdata   = &this->data[row * rowsize];
-    		for(unsigned int i = 0; i < width; i++, srcdata += 3, dstdata += 3) {
-          int gray = (srcdata[0] + srcdata[1] + srcdata[2]) / 3;
-          dstdata[0] = dstdata[1] = dstdata[2] = (unsigned char) gray;
-        }
-      }
+    if(src->bpp == 24 || src->bpp == 32) {
+      // Converts 24 and 32 bpp colors in data buffer
+      GCG_IMAGEFILTER8 filter;
+      setFilter8(&filter, src, this->data, rowsize, 0.0f);
+      gcgParallelRows(grayScaleRows8, &filter, height, GCG_IMAGE_MINROWS);
     } else
-      	if(src->bpp == 32) {
-          // Converts the 32bpp bitmap
-        	for(unsigned int row = 0; row < height; row++) {
-            unsigned char *srcdata   = &src->data[row * rowsize];
-            unsigned char *dstdata   = &this->data[row * rowsize];
-        		for(unsigned int i = 0; i < width; i++, srcdata += 4, dstdata += 4) {
-              int gray = (srcdata[0] + srcdata[1] + srcdata[2]) / 3;
-              dstdata[0] = dstdata[1] = dstdata[2] = (unsigned char) gray;
-              dstdata[3] = srcdata[3];  // Copy alpha channel
-            }
-          }
-        } else
             if(src->bpp == 16) {
               // Converts the 16bpp colors
               for(unsigned int currentRow = 0; currentRow < height; currentRow++) {
@@ -2620,28 +2793,14 @@ bool gcgIMAGE::convertGrayScale8bits(gcgIMAGE *src) {
         }
     }
   } else
-    if(src->bpp == 24) {
-    	// Converts 24bpp colors in data buffer
-    	for(unsigned int row = 0; row < height; row++) {
-        unsigned char *dstdat = &this->data[row * newrowsize];
-        unsigned char *srcdat = &srcdata[row * src->rowsize];
-    		for(unsigned int i = 0; i < width; i++, srcdat += 3, dstdat++) {
-          int gray = (srcdat[0] + srcdat[1] + srcdat[2]) / 3;
-          *dstdat = (unsigned char) gray;
-        }
-      }
+    if(src->bpp == 24 || src->bpp == 32) {
+      // Converts 24 and 32 bpp colors in data buffer
+      GCG_IMAGEFILTER8 filter;
+      setFilter8(&filter, src, this->data, newrowsize, 0.0f);
+      filter.src = srcdata;
+      filter.dstchannels = 1;
+      gcgParallelRows(grayScaleRows8, &filter, height, GCG_IMAGE_MINROWS);
     } else
-      	if(src->bpp == 32) {
-          // Converts the 32bpp bitmap
-        	for(unsigned int row = 0; row < height; row++) {
-        	  unsigned char *dstdat = &this->data[row * newrowsize];
-            unsigned char *srcdat = &srcdata[row * src->rowsize];
-        		for(unsigned int i = 0; i < width; i++, srcdat += 4, dstdat++) {
-              int gray = (srcdat[0] + srcdat[1] + srcdat[2]) / 3;
-              *dstdat = (unsigned char) gray;
-            }
-          }
-        } else
             if(src->bpp == 16) {
               // Converts the 16bpp colors
               for(unsigned int currentRow = 0; currentRow < height; currentRow++) {
@@ -2916,18 +3075,26 @@ bool gcgIMAGE::scale(float weight1, gcgIMAGE *srcimage1, float addthis) {
         }
       addthis *= bitmask;
 
-    	// Composition with colors with less than 9 bits in data buffer
-    	for(unsigned int row = 0; row < this->height; row++) {
-        register unsigned char *dstrow  = &this->data[row * rowsize];
-        register unsigned char *srcrow1 = &srcimage1->data[row * rowsize];
-    		for(unsigned int col = 0; col < width; col++) {
-    		  register float sum = addthis +
-                               weight1 * (float) ((srcrow1[col / pixelsperbyte] >> ((col % pixelsperbyte) * this->bpp)) & bitmask);
-          // Check bounds
-          unsigned char *ind = &dstrow[col / pixelsperbyte], val = (unsigned char) ((sum < 0.0) ? 0 : ((sum > bitmask) ? bitmask : sum));
-          int rshift = (col % pixelsperbyte) * bpp;
-          *ind = (*ind ^ (*ind & (bitmask << rshift))) | ((val & bitmask) << rshift);
-    		}
+      if(srcimage1->bpp == 8) {
+        // One index per byte: scaled as a plain 8 bits channel
+        GCG_IMAGEFILTER8 filter;
+        setFilter8(&filter, srcimage1, this->data, rowsize, addthis);
+        filter.weight1 = weight1;
+        gcgParallelRows(combineRows8, &filter, height, GCG_IMAGE_MINROWS);
+      } else {
+      	// Composition with colors with less than 9 bits in data buffer
+      	for(unsigned int row = 0; row < this->height; row++) {
+          register unsigned char *dstrow  = &this->data[row * rowsize];
+          register unsigned char *srcrow1 = &srcimage1->data[row * rowsize];
+      		for(unsigned int col = 0; col < width; col++) {
+      		  register float sum = addthis +
+                                 weight1 * (float) ((srcrow1[col / pixelsperbyte] >> ((col % pixelsperbyte) * this->bpp)) & bitmask);
+            // Check bounds
+            unsigned char *ind = &dstrow[col / pixelsperbyte], val = (unsigned char) ((sum < 0.0) ? 0 : ((sum > bitmask) ? bitmask : sum));
+            int rshift = (col % pixelsperbyte) * bpp;
+            *ind = (*ind ^ (*ind & (bitmask << rshift))) | ((val & bitmask) << rshift);
+      		}
+        }
       }
     } else {
       unsigned char *dstdata = NULL;
@@ -2996,43 +3163,13 @@ bool gcgIMAGE::scale(float weight1, gcgIMAGE *srcimage1, float addthis) {
         return false;
       }
 
-    if(srcimage1->bpp == 24) {
-      addthis *= 255.0; // 8 bits/channel
-    	// Scaling with 24 bits colors in data buffer
-    	for(unsigned int row = 0; row < height; row++) {
-        register unsigned char *dstrow  = &this->data[row * rowsize];
-        register unsigned char *srcrow1 = &srcimage1->data[row * rowsize];
-    		for(unsigned int col = 0; col < width; col++, dstrow += 3, srcrow1 += 3) {
-          register float sumR = addthis + weight1 * (float) srcrow1[0];
-          register float sumG = addthis + weight1 * (float) srcrow1[1];
-          register float sumB = addthis + weight1 * (float) srcrow1[2];
-          // Check bounds
-          dstrow[0] = (sumR < 0.0) ? 0 : ((sumR > 255.0) ? 255 : (unsigned char) sumR);
-          dstrow[1] = (sumG < 0.0) ? 0 : ((sumG > 255.0) ? 255 : (unsigned char) sumG);
-          dstrow[2] = (sumB < 0.0) ? 0 : ((sumB > 255.0) ? 255 : (unsigned char) sumB);
-    		}
-      }
+    if(srcimage1->bpp == 24 || srcimage1->bpp == 32) {
+      // 8 bits/channel
+      GCG_IMAGEFILTER8 filter;
+      setFilter8(&filter, srcimage1, this->data, rowsize, addthis * 255.0f);
+      filter.weight1 = weight1;
+      gcgParallelRows(combineRows8, &filter, height, GCG_IMAGE_MINROWS);
     } else
-      	if(srcimage1->bpp == 32) {
-          addthis *= 255.0; // 8 bits/channel
-          // Scaling with 32 bits colors in data buffer
-          for(unsigned int row = 0; row < height; row++) {
-            register unsigned char *dstrow  = &this->data[row * rowsize];
-            register unsigned char *srcrow1 = &srcimage1->data[row * rowsize];
-            for(unsigned int col = 0; col < width; col++, dstrow += 4, srcrow1 += 4) {
-              register float sumR = addthis + weight1 * (float) srcrow1[0];
-              register float sumG = addthis + weight1 * (float) srcrow1[1];
-              register float sumB = addthis + weight1 * (float) srcrow1[2];
-              register float sumA = addthis + weight1 * (float) srcrow1[3];
-
-              // Check bounds
-              dstrow[0] = (sumR < 0.0) ? 0 : ((sumR > 255.0) ? 255 : (unsigned char) sumR);
-              dstrow[1] = (sumG < 0.0) ? 0 : ((sumG > 255.0) ? 255 : (unsigned char) sumG);
-              dstrow[2] = (sumB < 0.0) ? 0 : ((sumB > 255.0) ? 255 : (unsigned char) sumB);
-              dstrow[3] = (sumA < 0.0) ? 0 : ((sumA > 255.0) ? 255 : (unsigned char) sumA);
-            }
-          }
-        } else
             if(srcimage1->bpp == 16) {
               // Scaling with 16 bits colors in data buffer
               float addthisR = addthis * max[0];
@@ -3097,20 +3234,31 @@ bool gcgIMAGE::combineAdd(gcgIMAGE *srcimage1, gcgIMAGE *srcimage2, float weight
         }
       addthis *= bitmask;
 
-    	// Composition with colors with less than 9 bits in data buffer
-    	for(unsigned int row = 0; row < this->height; row++) {
-        register unsigned char *dstrow  = &this->data[row * rowsize];
-        register unsigned char *srcrow1 = &srcimage1->data[row * rowsize];
-        register unsigned char *srcrow2 = &srcimage2->data[row * rowsize];
-    		for(unsigned int col = 0; col < width; col++) {
-    		  register float sum = addthis +
-                               weight1 * (float) ((srcrow1[col / pixelsperbyte] >> ((col % pixelsperbyte) * this->bpp)) & bitmask) +
-                               weight2 * (float) ((srcrow2[col / pixelsperbyte] >> ((col % pixelsperbyte) * this->bpp)) & bitmask);
-          // Check bounds
-          unsigned char *ind = &dstrow[col / pixelsperbyte], val = (unsigned char) ((sum < 0.0) ? 0 : ((sum > bitmask) ? bitmask : sum));
-          int rshift = (col % pixelsperbyte) * bpp;
-          *ind = (*ind ^ (*ind & (bitmask << rshift))) | ((val & bitmask) << rshift);
-    		}
+      if(srcimage1->bpp == 8) {
+        // One index per byte: combined as a plain 8 bits channel
+        GCG_IMAGEFILTER8 filter;
+        setFilter8(&filter, srcimage1, this->data, rowsize, addthis);
+        filter.src2 = srcimage2->data;
+        filter.src2rowsize = srcimage2->rowsize;
+        filter.weight1 = weight1;
+        filter.weight2 = weight2;
+        gcgParallelRows(combineRows8, &filter, height, GCG_IMAGE_MINROWS);
+      } else {
+      	// Composition with colors with less than 9 bits in data buffer
+      	for(unsigned int row = 0; row < this->height; row++) {
+          register unsigned char *dstrow  = &this->data[row * rowsize];
+          register unsigned char *srcrow1 = &srcimage1->data[row * rowsize];
+          register unsigned char *srcrow2 = &srcimage2->data[row * rowsize];
+      		for(unsigned int col = 0; col < width; col++) {
+      		  register float sum = addthis +
+                                 weight1 * (float) ((srcrow1[col / pixelsperbyte] >> ((col % pixelsperbyte) * this->bpp)) & bitmask) +
+                                 weight2 * (float) ((srcrow2[col / pixelsperbyte] >> ((col % pixelsperbyte) * this->bpp)) & bitmask);
+            // Check bounds
+            unsigned char *ind = &dstrow[col / pixelsperbyte], val = (unsigned char) ((sum < 0.0) ? 0 : ((sum > bitmask) ? bitmask : sum));
+            int rshift = (col % pixelsperbyte) * bpp;
+            *ind = (*ind ^ (*ind & (bitmask << rshift))) | ((val & bitmask) << rshift);
+      		}
+        }
       }
     } else {
       unsigned char *dstdata = NULL;
@@ -3181,45 +3329,16 @@ bool gcgIMAGE::combineAdd(gcgIMAGE *srcimage1, gcgIMAGE *srcimage2, float weight
         return false; // createSimilar creates only what is needed to make them compatible.
       }
 
-    if(srcimage1->bpp == 24) {
-      addthis *= 255.0; // 8 bits/channel
-    	// Combination with 24bits colors in data buffer
-    	for(unsigned int row = 0; row < height; row++) {
-        register unsigned char *dstrow  = &this->data[row * rowsize];
-        register unsigned char *srcrow1 = &srcimage1->data[row * rowsize];
-        register unsigned char *srcrow2 = &srcimage2->data[row * rowsize];
-    		for(unsigned int col = 0; col < width; col++, dstrow += 3, srcrow1 += 3, srcrow2 += 3) {
-          register float sumR = addthis + weight1 * (float) srcrow1[0] + weight2 * (float) srcrow2[0];
-          register float sumG = addthis + weight1 * (float) srcrow1[1] + weight2 * (float) srcrow2[1];
-          register float sumB = addthis + weight1 * (float) srcrow1[2] + weight2 * (float) srcrow2[2];
-          // Check bounds
-          dstrow[0] = (sumR < 0.0) ? 0 : ((sumR > 255.0) ? 255 : (unsigned char) sumR);
-          dstrow[1] = (sumG < 0.0) ? 0 : ((sumG > 255.0) ? 255 : (unsigned char) sumG);
-          dstrow[2] = (sumB < 0.0) ? 0 : ((sumB > 255.0) ? 255 : (unsigned char) sumB);
-    		}
-      }
+    if(srcimage1->bpp == 24 || srcimage1->bpp == 32) {
+      // 8 bits/channel
+      GCG_IMAGEFILTER8 filter;
+      setFilter8(&filter, srcimage1, this->data, rowsize, addthis * 255.0f);
+      filter.src2 = srcimage2->data;
+      filter.src2rowsize = srcimage2->rowsize;
+      filter.weight1 = weight1;
+      filter.weight2 = weight2;
+      gcgParallelRows(combineRows8, &filter, height, GCG_IMAGE_MINROWS);
     } else
-      	if(srcimage1->bpp == 32) {
-          addthis *= 255.0; // 8 bits/channel
-          // Combination with 32bits colors in data buffer
-          for(unsigned int row = 0; row < height; row++) {
-            register unsigned char *dstrow  = &this->data[row * rowsize];
-            register unsigned char *srcrow1 = &srcimage1->data[row * rowsize];
-            register unsigned char *srcrow2 = &srcimage2->data[row * rowsize];
-            for(unsigned int col = 0; col < width; col++, dstrow += 4, srcrow1 += 4, srcrow2 += 4) {
-              register float sumR = addthis + weight1 * (float) srcrow1[0] + weight2 * (float) srcrow2[0];
-              register float sumG = addthis + weight1 * (float) srcrow1[1] + weight2 * (float) srcrow2[1];
-              register float sumB = addthis + weight1 * (float) srcrow1[2] + weight2 * (float) srcrow2[2];
-              register float sumA = addthis + weight1 * (float) srcrow1[3] + weight2 * (float) srcrow2[3];
-
-              // Check bounds
-              dstrow[0] = (sumR < 0.0) ? 0 : ((sumR > 255.0) ? 255 : (unsigned char) sumR);
-              dstrow[1] = (sumG < 0.0) ? 0 : ((sumG > 255.0) ? 255 : (unsigned char) sumG);
-              dstrow[2] = (sumB < 0.0) ? 0 : ((sumB > 255.0) ? 255 : (unsigned char) sumB);
-              dstrow[3] = (sumA < 0.0) ? 0 : ((sumA > 255.0) ? 255 : (unsigned char) sumA);
-            }
-          }
-        } else
             if(srcimage1->bpp == 16) {
               // Combination with 16 bits colors in data buffer
               float addthisR = addthis * max[0];
@@ -1139,15 +1139,37 @@ bool gcgDISCRETE2D<NUMBERTYPE>::convolutionX(gcgDISCRETE2D<NUMBERTYPE> *src, gcg
     }
   }
 
+  // Rows are independent: they are processed in bands
+  struct CONVOLUTIONROWS {
+    NUMBERTYPE  *dstdata, *srcdata;
+    CROSSTYPE   *maskdata;
+    int         width, srcextension, masklength, maskextension, maskorigin;
+    bool        zero2;
+
+    static void rows(void *args, unsigned int firstrow, unsigned int lastrow) {
+      CONVOLUTIONROWS *c = (CONVOLUTIONROWS*) args;
+      NUMBERTYPE *dstrow = &c->dstdata[firstrow * c->width];
+      NUMBERTYPE *srcrow = &c->srcdata[firstrow * c->width];
+      if(c->zero2)
+        for(unsigned int row = firstrow; row < lastrow; row++, srcrow += c->width, dstrow += c->width)
+          convolution1D_zero2(dstrow, c->width, srcrow, c->srcextension, c->masklength, c->maskdata, c->maskorigin);
+      else
+        for(unsigned int row = firstrow; row < lastrow; row++, srcrow += c->width, dstrow += c->width)
+          convolution1D_zero1(dstrow, c->width, srcrow, c->masklength, c->maskdata, c->maskextension, c->maskorigin);
+    }
+  } conv;
+
   // Convolution in data buffer
-  NUMBERTYPE *dstrow = dstdata;
-  NUMBERTYPE *srcrow = src->data;
-  if(mask->extension == GCG_BORDER_EXTENSION_ZERO || src->extensionX != GCG_BORDER_EXTENSION_ZERO)
-    for(unsigned int row = 0; row < height; row++, srcrow += width, dstrow += width)
-      convolution1D_zero2(dstrow, src->width, srcrow, src->extensionX, mask->length, mask->data, mask->origin);
-  else
-    for(unsigned int row = 0; row < height; row++, srcrow += width, dstrow += width)
-      convolution1D_zero1(dstrow, src->width, srcrow, mask->length, mask->data, mask->extension, mask->origin);
+  conv.dstdata = dstdata;
+  conv.srcdata = src->data;
+  conv.maskdata = mask->data;
+  conv.width = (int) src->width;
+  conv.srcextension = src->extensionX;
+  conv.masklength = mask->length;
+  conv.maskextension = mask->extension;
+  conv.maskorigin = mask->origin;
+  conv.zero2 = (mask->extension == GCG_BORDER_EXTENSION_ZERO || src->extensionX != GCG_BORDER_EXTENSION_ZERO);
+  gcgParallelRows(CONVOLUTIONROWS::rows, &conv, height, GCG_SIGNAL_MINROWS);
 
   // Commit filtered data
   if((void*) this == (void*) src) {
@@ -1188,62 +1210,52 @@ bool gcgDISCRETE2D<NUMBERTYPE>::convolutionY(gcgDISCRETE2D<NUMBERTYPE> *src, gcg
     }
   }
 
-  // Convolution in data buffer
-  if(mask->extension == GCG_BORDER_EXTENSION_ZERO)
-    switch(src->extensionY) {
-      case GCG_BORDER_EXTENSION_SYMMETRIC_NOREPEAT:
-              for(unsigned int row = 0; row < height; row++)
-                convolutionsymmetricnorepeat2D1D_zero2(&dstdata[row * width], row, src->width, src->height, src->data, mask->length, mask->data, mask->origin);
-              break;
-
-      case GCG_BORDER_EXTENSION_SYMMETRIC_REPEAT:
-              for(unsigned int row = 0; row < height; row++)
-                convolutionsymmetricrepeat2D1D_zero2(&dstdata[row * width], row, src->width, src->height, src->data, mask->length, mask->data, mask->origin);
-              break;
-
-       case GCG_BORDER_EXTENSION_PERIODIC:
-              for(unsigned int row = 0; row < height; row++)
-                convolutionperiodic2D1D_zero2(&dstdata[row * width], row, src->width, src->height, src->data, mask->length, mask->data, mask->origin);
-              break;
+  // Rows are independent: they are processed in bands
+  typedef void (*CONVOLUTIONCOLUMN)(NUMBERTYPE*, int, int, int, NUMBERTYPE*, int, CROSSTYPE*, int);
+  struct CONVOLUTIONROWS {
+    CONVOLUTIONCOLUMN convolution;
+    NUMBERTYPE        *dstdata, *srcdata;
+    CROSSTYPE         *maskdata;
+    int               width, height, masklength, maskorigin;
 
-       case GCG_BORDER_EXTENSION_CLAMP:
-              for(unsigned int row = 0; row < height; row++)
-                convolutionclamp2D1D_zero2(&dstdata[row * width], row, src->width, src->height, src->data, mask->length, mask->data, mask->origin);
-              break;
+    static void rows(void *args, unsigned int firstrow, unsigned int lastrow) {
+      CONVOLUTIONROWS *c = (CONVOLUTIONROWS*) args;
+      for(unsigned int row = firstrow; row < lastrow; row++)
+        c->convolution(&c->dstdata[row * c->width], row, c->width, c->height, c->srcdata, c->masklength, c->maskdata, c->maskorigin);
+    }
+  } conv;
 
-       case GCG_BORDER_EXTENSION_ZERO:
-              for(unsigned int row = 0; row < height; row++)
-                convolutionzero2D1D_zero2(&dstdata[row * width], row, src->width, src->height, src->data, mask->length, mask->data, mask->origin);
-              break;
+  // Select the column convolution
+  conv.convolution = NULL;
+  if(mask->extension == GCG_BORDER_EXTENSION_ZERO)
+    switch(src->extensionY) {
+      case GCG_BORDER_EXTENSION_SYMMETRIC_NOREPEAT: conv.convolution = convolutionsymmetricnorepeat2D1D_zero2; break;
+      case GCG_BORDER_EXTENSION_SYMMETRIC_REPEAT:   conv.convolution = convolutionsymmetricrepeat2D1D_zero2; break;
+      case GCG_BORDER_EXTENSION_PERIODIC:           conv.convolution = convolutionperiodic2D1D_zero2; break;
+      case GCG_BORDER_EXTENSION_CLAMP:              conv.convolution = convolutionclamp2D1D_zero2; break;
+      case GCG_BORDER_EXTENSION_ZERO:               conv.convolution = convolutionzero2D1D_zero2; break;
     }
   else
     switch(src->extensionY) {
-      case GCG_BORDER_EXTENSION_SYMMETRIC_NOREPEAT:
-              for(unsigned int row = 0; row < height; row++)
-                convolutionsymmetricnorepeat2D1D_zero1(&dstdata[row * width], row, src->width, src->height, src->data, mask->length, mask->data, mask->origin);
-              break;
-
-      case GCG_BORDER_EXTENSION_SYMMETRIC_REPEAT:
-              for(unsigned int row = 0; row < height; row++)
-                convolutionsymmetricrepeat2D1D_zero1(&dstdata[row * width], row, src->width, src->height, src->data, mask->length, mask->data, mask->origin);
-              break;
-
-       case GCG_BORDER_EXTENSION_PERIODIC:
-              for(unsigned int row = 0; row < height; row++)
-                convolutionperiodic2D1D_zero1(&dstdata[row * width], row, src->width, src->height, src->data, mask->length, mask->data, mask->origin);
-              break;
-
-       case GCG_BORDER_EXTENSION_CLAMP:
-              for(unsigned int row = 0; row < height; row++)
-                convolutionclamp2D1D_zero1(&dstdata[row * width], row, src->width, src->height, src->data, mask->length, mask->data, mask->origin);
-              break;
-
-       case GCG_BORDER_EXTENSION_ZERO:
-              for(unsigned int row = 0; row < height; row++)
-                convolutionzero2D1D_zero2(&dstdata[row * width], row, src->width, src->height, src->data, mask->length, mask->data, mask->origin);
-              break;
+      case GCG_BORDER_EXTENSION_SYMMETRIC_NOREPEAT: conv.convolution = convolutionsymmetricnorepeat2D1D_zero1; break;
+      case GCG_BORDER_EXTENSION_SYMMETRIC_REPEAT:   conv.convolution = convolutionsymmetricrepeat2D1D_zero1; break;
+      case GCG_BORDER_EXTENSION_PERIODIC:           conv.convolution = convolutionperiodic2D1D_zero1; break;
+      case GCG_BORDER_EXTENSION_CLAMP:              conv.convolution = convolutionclamp2D1D_zero1; break;
+      case GCG_BORDER_EXTENSION_ZERO:               conv.convolution = convolutionzero2D1D_zero2; break;
     }
 
+  // Convolution in data buffer
+  if(conv.convolution != NULL) {
+    conv.dstdata = dstdata;
+    conv.srcdata = src->data;
+    conv.maskdata = mask->data;
+    conv.width = (int) src->width;
+    conv.height = (int) src->height;
+    conv.masklength = mask->length;
+    conv.maskorigin = mask->origin;
+    gcgParallelRows(CONVOLUTIONROWS::rows, &conv, height, GCG_SIGNAL_MINROWS);
+  }
+
   // Commit filtered data
   if((void*) this == (void*) src) {
     // We have new data
@@ -1482,13 +1494,33 @@ bool gcgDISCRETE2D<NUMBERTYPE>::combineAdd(gcgDISCRETE2D<NUMBERTYPE> *srcsignal1
   if((void*) this != (void*) srcsignal1 && (void*) this != (void*) srcsignal2)
     if(!this->createSimilar(srcsignal1)) return false; // createSimilar creates only what is needed to make them compatible.
 
+  // Rows are independent: they are processed in bands
+  struct COMBINEROWS {
+    NUMBERTYPE    *dstdata, *srcdata1;
+    CROSSTYPE     *srcdata2;
+    unsigned int  width;
+    COERSIONTYPE  weight1, weight2;
+
+    static void rows(void *args, unsigned int firstrow, unsigned int lastrow) {
+      COMBINEROWS *c = (COMBINEROWS*) args;
+      register NUMBERTYPE *dstrow  = &c->dstdata[firstrow * c->width];
+      register NUMBERTYPE *srcrow1 = &c->srcdata1[firstrow * c->width];
+      register CROSSTYPE  *srcrow2 = &c->srcdata2[firstrow * c->width];
+      register COERSIONTYPE weight1 = c->weight1, weight2 = c->weight2;
+      unsigned int size = (lastrow - firstrow) * c->width;
+      for(unsigned int i = 0; i < size; i++, dstrow++, srcrow1++, srcrow2++)
+        *dstrow = (NUMBERTYPE) (weight1 * (COERSIONTYPE) *srcrow1 + (COERSIONTYPE) weight2 * *srcrow2);
+    }
+  } comb;
+
   // Combination data buffer
-  register NUMBERTYPE *dstrow  = this->data;
-  register NUMBERTYPE *srcrow1 = srcsignal1->data;
-  register CROSSTYPE  *srcrow2 = srcsignal2->data;
-  unsigned int size = width * height;
-  for(unsigned int i = 0; i < size; i++, dstrow++, srcrow1++, srcrow2++)
-      *dstrow = (NUMBERTYPE) (weight1 * (COERSIONTYPE) *srcrow1 + (COERSIONTYPE) weight2 * *srcrow2);
+  comb.dstdata  = this->data;
+  comb.srcdata1 = srcsignal1->data;
+  comb.srcdata2 = srcsignal2->data;
+  comb.width    = width;
+  comb.weight1  = weight1;
+  comb.weight2  = weight2;
+  gcgParallelRows(COMBINEROWS::rows, &comb, height, GCG_SIGNAL_MINROWS);
 
   // Ok, it's done
 	//errorcode = GCG_SUCCESS;
@@ -1835,7 +1867,90 @@ template<> bool gcgOpticalFlowAugereau2D<NUMBERTYPE>(gcgDISCRETE2D<NUMBERTYPE> *
                                                      gcgDISCRETE2D<NUMBERTYPE> *dx2, gcgDISCRETE2D<NUMBERTYPE> *dy2, gcgDISCRETE2D<NUMBERTYPE> *dt2,
                                                      gcgDISCRETE2D<NUMBERTYPE> *dx3, gcgDISCRETE2D<NUMBERTYPE> *dy3, gcgDISCRETE2D<NUMBERTYPE> *dt3,
                                                      gcgDISCRETE2D<CROSSTYPE> *outflowX, gcgDISCRETE2D<CROSSTYPE> *outflowY) {
-  VECTOR3 flowchannel1, flowchannel2, flowchannel3;
+  // Pixels are independent: rows are processed in bands
+  struct AUGEREAUROWS {
+    NUMBERTYPE    *dx[3], *dy[3], *dt[3];
+    CROSSTYPE     *flowX, *flowY;
+    unsigned int  width;
+
+    static void rows(void *args, unsigned int firstrow, unsigned int lastrow) {
+      AUGEREAUROWS *a = (AUGEREAUROWS*) args;
+      unsigned int end = lastrow * a->width;
+#if TYPECOUNTER != 2
+      // Single precision: 4 pixels at once
+      float c[9][4], flowX[4], flowY[4];
+      for(unsigned int ind = firstrow * a->width; ind < end; ind += 4) {
+        unsigned int n = MIN(4, end - ind);
+
+        // Primary estimation per channel: equation 6
+        for(unsigned int ch = 0; ch < 3; ch++) {
+          NUMBERTYPE *dx = &a->dx[ch][ind], *dy = &a->dy[ch][ind], *dt = &a->dt[ch][ind];
+          for(unsigned int p = 0; p < 4; p++)
+            if(p < n) {
+              c[3 * ch + 0][p] = (float) ((float) dx[p] * (float) dt[p]);
+              c[3 * ch + 1][p] = (float) ((float) dy[p] * (float) dt[p]);
+              c[3 * ch + 2][p] = (float) ((float) -(dx[p] * (float) dx[p] + (float) dy[p] * (float) dy[p]));
+            } else c[3 * ch + 0][p] = c[3 * ch + 1][p] = c[3 * ch + 2][p] = 0.0f;
+        }
+
+        // Final, multichannel estimation
+        augereauFlow4(c, flowX, flowY);
+        for(unsigned int p = 0; p < n; p++) {
+          a->flowX[ind + p] = (CROSSTYPE) flowX[p];
+          a->flowY[ind + p] = (CROSSTYPE) flowY[p];
+        }
+      }
+#else
+      VECTOR3 flowchannel1, flowchannel2, flowchannel3;
+      for(unsigned int ind = firstrow * a->width; ind < end; ind++) {
+        // Primary estimation per channel: equation 6
+        flowchannel1[0] = (float) ((float) a->dx[0][ind] * (float) a->dt[0][ind]);
+        flowchannel1[1] = (float) ((float) a->dy[0][ind] * (float) a->dt[0][ind]);
+        flowchannel1[2] = (float) ((float) -(a->dx[0][ind] * (float) a->dx[0][ind] + (float) a->dy[0][ind] * (float) a->dy[0][ind]));
+
+        flowchannel2[0] = (float) ((float) a->dx[1][ind] * (float) a->dt[1][ind]);
+        flowchannel2[1] = (float) ((float) a->dy[1][ind] * (float) a->dt[1][ind]);
+        flowchannel2[2] = (float) ((float) -(a->dx[1][ind] * (float) a->dx[1][ind] + (float) a->dy[1][ind] * (float) a->dy[1][ind]));
+
+        flowchannel3[0] = (float) ((float) a->dx[2][ind] * (float) a->dt[2][ind]);
+        flowchannel3[1] = (float) ((float) a->dy[2][ind] * (float) a->dt[2][ind]);
+        flowchannel3[2] = (float) ((float) -(a->dx[2][ind] * (float) a->dx[2][ind] + (float) a->dy[2][ind] * (float) a->dy[2][ind]));
+
+        // Final, multichannel estimation
+
+        // Power iteration to find first eigenvector
+        VECTOR3 eigenvector = {0.57735026f, 0.57735026f, 0.57735026f}; // Will contain first eigenvector: starts with 1.0/sqrt(3);
+        NUMBERTYPE eigenvalue = 0;    // Will contain first eigenvalue: starts with 0
+        bool success = true;
+        for(unsigned int k = 0; k < 15 && success; k++) {
+          NUMBERTYPE norm = (NUMBERTYPE) gcgDOTVECTOR3(eigenvector, eigenvector), dot1, dot2, dot3;
+          if(norm > EPSILON) {
+            dot1 = (NUMBERTYPE) gcgDOTVECTOR3(flowchannel1, eigenvector);
+            dot2 = (NUMBERTYPE) gcgDOTVECTOR3(flowchannel2, eigenvector);
+            dot3 = (NUMBERTYPE) gcgDOTVECTOR3(flowchannel3, eigenvector);
+            eigenvalue = (SQR(dot1) + SQR(dot2) + SQR(dot3)) / norm;
+            if(eigenvalue > EPSILON) {
+              VECTOR3 temp;
+              gcgSCALEVECTOR3(eigenvector, flowchannel1, (float) dot1);
+              gcgSCALEVECTOR3(temp, flowchannel2, (float) dot2);
+              gcgADDVECTOR3(eigenvector, eigenvector, temp);
+              gcgSCALEVECTOR3(temp, flowchannel3, (float) dot3);
+              gcgADDVECTOR3(eigenvector, eigenvector, temp);
+
+              // Update
+              gcgSCALEVECTOR3(eigenvector, eigenvector, (float) (1.0 / eigenvalue));
+            } else success = false;
+          } else success = false;
+        }
+
+        if(success && fabs(eigenvector[2]) > EPSILON) {
+          a->flowX[ind] = (CROSSTYPE) (eigenvector[0] / eigenvector[2]);
+          a->flowY[ind] = (CROSSTYPE) (eigenvector[1] / eigenvector[2]);
+        } else a->flowX[ind] = a->flowY[ind] = (CROSSTYPE) 0.0;
+      }
+#endif
+    }
+  } flow;
 
   // Check input parameters
   if(dx1 == NULL || dy1 == NULL || dt1 == NULL || dx2 == NULL || dy2 == NULL ||
@@ -1848,79 +1963,24 @@ template<> bool gcgOpticalFlowAugereau2D<NUMBERTYPE>(gcgDISCRETE2D<NUMBERTYPE> *
   outflowX->createSignal(width, height, dx1->originX, dx1->originY);
   outflowY->createSignal(width, height, dx1->originX, dx1->originY);
 
-  for(unsigned int j = 0, ind = 0; j < height; j++)
-    for(unsigned int i = 0; i < width; i++, ind++) {
-      // Primary estimation per channel: equation 6
-      flowchannel1[0] = (float) ((float) dx1->data[ind] * (float) dt1->data[ind]);
-      flowchannel1[1] = (float) ((float) dy1->data[ind] * (float) dt1->data[ind]);
-      flowchannel1[2] = (float) ((float) -(dx1->data[ind] * (float) dx1->data[ind] + (float) dy1->data[ind] * (float) dy1->data[ind]));
-
-      flowchannel2[0] = (float) ((float) dx2->data[ind] * (float) dt2->data[ind]);
-      flowchannel2[1] = (float) ((float) dy2->data[ind] * (float) dt2->data[ind]);
-      flowchannel2[2] = (float) ((float) -(dx2->data[ind] * (float) dx2->data[ind] + (float) dy2->data[ind] * (float) dy2->data[ind]));
-
-      flowchannel3[0] = (float) ((float) dx3->data[ind] * (float) dt3->data[ind]);
-      flowchannel3[1] = (float) ((float) dy3->data[ind] * (float) dt3->data[ind]);
-      flowchannel3[2] = (float) ((float) -(dx3->data[ind] * (float) dx3->data[ind] + (float) dy3->data[ind] * (float) dy3->data[ind]));
-
-      // Final, multichannel estimation
-
-      // Power iteration to find first eigenvector
-      VECTOR3 eigenvector = {0.57735026f, 0.57735026f, 0.57735026f}; // Will contain first eigenvector: starts with 1.0/sqrt(3);
-#if FLOATING
-      NUMBERTYPE eigenvalue = 0;    // Will contain first eigenvalue: starts with 0
-#else
-      float eigenvalue = 0;    // Will contain first eigenvalue: starts with 0
-#endif
-      bool success = true;
-      for(unsigned int k = 0; k < 15 && success; k++) {
-#if FLOATING
-        NUMBERTYPE norm = (NUMBERTYPE) gcgDOTVECTOR3(eigenvector, eigenvector), dot1, dot2, dot3;
-#else
-        float norm = (float) gcgDOTVECTOR3(eigenvector, eigenvector), dot1, dot2, dot3;
-#endif
-        if(norm > EPSILON) {
-#if FLOATING
-          dot1 = (NUMBERTYPE) gcgDOTVECTOR3(flowchannel1, eigenvector);
-          dot2 = (NUMBERTYPE) gcgDOTVECTOR3(flowchannel2, eigenvector);
-          dot3 = (NUMBERTYPE) gcgDOTVECTOR3(flowchannel3, eigenvector);
-#else
-          dot1 = (float) gcgDOTVECTOR3(flowchannel1, eigenvector);
-          dot2 = (float) gcgDOTVECTOR3(flowchannel2, eigenvector);
-          dot3 = (float) gcgDOTVECTOR3(flowchannel3, eigenvector);
-#endif
-          eigenvalue = (SQR(dot1) + SQR(dot2) + SQR(dot3)) / norm;
-          if(eigenvalue > EPSILON) {
-            VECTOR3 temp;
-            gcgSCALEVECTOR3(eigenvector, flowchannel1, (float) dot1);
-            gcgSCALEVECTOR3(temp, flowchannel2, (float) dot2);
-            gcgADDVECTOR3(eigenvector, eigenvector, temp);
-            gcgSCALEVECTOR3(temp, flowchannel3, (float) dot3);
-            gcgADDVECTOR3(eigenvector, eigenvector, temp);
-
-            // Update
-            gcgSCALEVECTOR3(eigenvector, eigenvector, (float) (1.0 / eigenvalue));
-          } else success = false;
-        } else success = false;
-      }
-
-      // NOTE: the code above has the same effect of the code:
-      //      MATRIX3 m, mv;
-      //      VECTOR3 eigenvalues;
-      //      gcgTENSORPRODUCT3(m, flowchannel1, flowchannel1);
-      //      gcgTENSORPRODUCT3(mv, flowchannel2, flowchannel2);
-      //      gcgADDMATRIX3(m, m, mv);
-      //      gcgTENSORPRODUCT3(mv, flowchannel3, flowchannel3);
-      //      gcgADDMATRIX3(m, m, mv);
-      //      gcgEigenSymmetricMatrix3(m, mv, eigenvalues);
-      //      gcgCOPYVECTOR3(eigenvector, &mv[6]);
-      //      eigenvalue = eigenvalues[2];
-
-      if(success && fabs(eigenvector[2]) > EPSILON) {
-        outflowX->data[ind] = (CROSSTYPE) (eigenvector[0] / eigenvector[2]);
-        outflowY->data[ind] = (CROSSTYPE) (eigenvector[1] / eigenvector[2]);
-      } else outflowX->data[ind] = outflowY->data[ind] = (CROSSTYPE) 0.0;
-    }
+  // NOTE: the power iteration has the same effect of the code:
+  //      MATRIX3 m, mv;
+  //      VECTOR3 eigenvalues;
+  //      gcgTENSORPRODUCT3(m, flowchannel1, flowchannel1);
+  //      gcgTENSORPRODUCT3(mv, flowchannel2, flowchannel2);
+  //      gcgADDMATRIX3(m, m, mv);
+  //      gcgTENSORPRODUCT3(mv, flowchannel3, flowchannel3);
+  //      gcgADDMATRIX3(m, m, mv);
+  //      gcgEigenSymmetricMatrix3(m, mv, eigenvalues);
+  //      gcgCOPYVECTOR3(eigenvector, &mv[6]);
+  //      eigenvalue = eigenvalues[2];
+  flow.dx[0] = dx1->data; flow.dy[0] = dy1->data; flow.dt[0] = dt1->data;
+  flow.dx[1] = dx2->data; flow.dy[1] = dy2->data; flow.dt[1] = dt2->data;
+  flow.dx[2] = dx3->data; flow.dy[2] = dy3->data; flow.dt[2] = dt3->data;
+  flow.flowX = outflowX->data;
+  flow.flowY = outflowY->data;
+  flow.width = width;
+  gcgParallelRows(AUGEREAUROWS::rows, &flow, height, GCG_SIGNAL_MINROWS);
 
   // Optical flow computed
   return true;
@@ -20,6 +20,92 @@
 
   #include "system.h"
 
+  #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define GCG_SIGNAL_SSE2
+  #endif
+
+  // Minimum number of rows per band given to gcgParallelRows()
+  #define GCG_SIGNAL_MINROWS 16
+
+  // Smallest float greater than EPSILON: (float) x > EPSILON is the same as x >= AUGEREAU_EPSILON
+  static float floatAboveEpsilon() {
+    union { float f; unsigned int u; } e;
+    e.f = (float) EPSILON;
+    while((double) e.f <= EPSILON) e.u++;
+    return e.f;
+  }
+  static const float AUGEREAU_EPSILON = floatAboveEpsilon();
+
+  ////////////////////////////////////////////////////////////
+  // Power iteration of the Augereau optical flow for 4 pixels in single
+  // precision. c[3 * channel + component][pixel] holds the primary estimation
+  // of each channel. Follows exactly the operations of the per pixel code:
+  // results are identical. Pixels that fail get a null flow.
+  ////////////////////////////////////////////////////////////
+  static void augereauFlow4(float c[9][4], float flowX[4], float flowY[4]) {
+  #ifdef GCG_SIGNAL_SSE2
+    __m128 v[9];
+    for(int i = 0; i < 9; i++) v[i] = _mm_loadu_ps(c[i]);
+
+    const __m128 eps = _mm_set1_ps(AUGEREAU_EPSILON);
+    const __m128d one = _mm_set1_pd(1.0);
+    __m128 e0 = _mm_set1_ps(0.57735026f), e1 = e0, e2 = e0; // Starts with 1.0/sqrt(3)
+    __m128 active = _mm_cmpeq_ps(e0, e0);
+    for(unsigned int k = 0; k < 15; k++) {
+      __m128 norm = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e0, e0), _mm_mul_ps(e1, e1)), _mm_mul_ps(e2, e2));
+      active = _mm_and_ps(active, _mm_cmpge_ps(norm, eps));
+      if(!_mm_movemask_ps(active)) break;
+
+      __m128 dot1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[0], e0), _mm_mul_ps(v[1], e1)), _mm_mul_ps(v[2], e2));
+      __m128 dot2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[3], e0), _mm_mul_ps(v[4], e1)), _mm_mul_ps(v[5], e2));
+      __m128 dot3 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[6], e0), _mm_mul_ps(v[7], e1)), _mm_mul_ps(v[8], e2));
+      __m128 eigenvalue = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dot1, dot1), _mm_mul_ps(dot2, dot2)), _mm_mul_ps(dot3, dot3)), norm);
+      active = _mm_and_ps(active, _mm_cmpge_ps(eigenvalue, eps));
+      if(!_mm_movemask_ps(active)) break;
+
+      // Reciprocal computed in double precision, as in (float) (1.0 / eigenvalue)
+      __m128 inv = _mm_movelh_ps(_mm_cvtpd_ps(_mm_div_pd(one, _mm_cvtps_pd(eigenvalue))),
+                                 _mm_cvtpd_ps(_mm_div_pd(one, _mm_cvtps_pd(_mm_movehl_ps(eigenvalue, eigenvalue)))));
+
+      // Failed pixels keep iterating on garbage: their flow is discarded below
+      e0 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(v[0], dot1), _mm_mul_ps(v[3], dot2)), _mm_mul_ps(v[6], dot3)), inv);
+      e1 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(v[1], dot1), _mm_mul_ps(v[4], dot2)), _mm_mul_ps(v[7], dot3)), inv);
+      e2 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(v[2], dot1), _mm_mul_ps(v[5], dot2)), _mm_mul_ps(v[8], dot3)), inv);
+    }
+
+    __m128 abse2 = _mm_and_ps(e2, _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)));
+    active = _mm_and_ps(active, _mm_cmpge_ps(abse2, eps));
+    _mm_storeu_ps(flowX, _mm_and_ps(active, _mm_div_ps(e0, e2)));
+    _mm_storeu_ps(flowY, _mm_and_ps(active, _mm_div_ps(e1, e2)));
+  #else
+    for(int p = 0; p < 4; p++) {
+      float e0 = 0.57735026f, e1 = e0, e2 = e0; // Starts with 1.0/sqrt(3)
+      bool success = true;
+      for(unsigned int k = 0; k < 15 && success; k++) {
+        float norm = e0 * e0 + e1 * e1 + e2 * e2;
+        if(norm > EPSILON) {
+          float dot1 = c[0][p] * e0 + c[1][p] * e1 + c[2][p] * e2;
+          float dot2 = c[3][p] * e0 + c[4][p] * e1 + c[5][p] * e2;
+          float dot3 = c[6][p] * e0 + c[7][p] * e1 + c[8][p] * e2;
+          float eigenvalue = (dot1 * dot1 + dot2 * dot2 + dot3 * dot3) / norm;
+          if(eigenvalue > EPSILON) {
+            float inv = (float) (1.0 / eigenvalue);
+            e0 = (c[0][p] * dot1 + c[3][p] * dot2 + c[6][p] * dot3) * inv;
+            e1 = (c[1][p] * dot1 + c[4][p] * dot2 + c[7][p] * dot3) * inv;
+            e2 = (c[2][p] * dot1 + c[5][p] * dot2 + c[8][p] * dot3) * inv;
+          } else success = false;
+        } else success = false;
+      }
+
+      if(success && fabs(e2) > EPSILON) {
+        flowX[p] = e0 / e2;
+        flowY[p] = e1 / e2;
+      } else flowX[p] = flowY[p] = 0.0f;
+    }
+  #endif
+  }
+
   #define TYPECOUNTER 1
   #define NUMBERTYPE float
   #define NUMBERTYPE_MIN -((float) INF)
@@ -569,6 +569,14 @@ inline static void gcgComputeTimeout(struct timespec *t, long n) {
 // INTERNAL FUNCTIONS
 /////////////////////////////////////////////////////////
 
+// Kernel called by gcgParallelRows() for the rows in [firstrow, lastrow).
+typedef void (*GCG_ROWSKERNEL)(void *args, unsigned int firstrow, unsigned int lastrow);
+
+// Processes the rows [0, nrows) in bands of at least minrows rows using a thread pool shared by
+// the internal filters. The caller also processes bands, so it can be called from inside jobs.
+// Returns when all bands are done. Kernels must write disjoint rows.
+void gcgParallelRows(GCG_ROWSKERNEL kernel, void *args, unsigned int nrows, unsigned int minrows);
+
 
 
 
@@ -1199,3 +1199,145 @@ unsigned int gcgTHREADPOOL::getNumberOfThreads() {
   return res;
 }
 
+
+
+//////////////////////////////////////////////////////////////////////
+// gcgParallelRows: splits internal filters in bands of rows
+//////////////////////////////////////////////////////////////////////
+
+// Internal struct: shared by the caller and the jobs of one gcgParallelRows() call. It is
+// released by the last one leaving, since a job may start after all bands were processed.
+typedef struct _GCG_ROWBANDS {
+  pthread_mutex_t mutex;          // Mutex for accessing this struct
+  pthread_cond_t  donecond;       // Signals when all rows were processed
+
+  GCG_ROWSKERNEL  kernel;         // Function processing a band
+  void            *args;          // Kernel arguments
+  unsigned int    nrows;          // Total number of rows
+  unsigned int    bandrows;       // Number of rows of each band
+  unsigned int    nextrow;        // First row of the next unclaimed band
+  unsigned int    pendingrows;    // Rows still being processed
+  unsigned int    references;     // Caller plus assigned jobs
+} GCG_ROWBANDS;
+
+// Claims and processes bands until none is left
+static void processRowBands(GCG_ROWBANDS *bands) {
+  while(true) {
+    pthread_mutex_lock(&bands->mutex);
+      unsigned int first = bands->nextrow;
+      unsigned int last  = MIN(first + bands->bandrows, bands->nrows);
+      if(first < last) bands->nextrow = last;
+    pthread_mutex_unlock(&bands->mutex);
+    if(first >= last) return;
+
+    bands->kernel(bands->args, first, last);
+
+    pthread_mutex_lock(&bands->mutex);
+      bands->pendingrows -= last - first;
+      if(bands->pendingrows == 0) pthread_cond_broadcast(&bands->donecond);
+    pthread_mutex_unlock(&bands->mutex);
+  }
+}
+
+// Releases one reference to the bands
+static void releaseRowBands(GCG_ROWBANDS *bands) {
+  pthread_mutex_lock(&bands->mutex);
+    bool lastreference = (--bands->references == 0);
+  pthread_mutex_unlock(&bands->mutex);
+
+  if(lastreference) {
+    pthread_cond_destroy(&bands->donecond);
+    pthread_mutex_destroy(&bands->mutex);
+    FREE(bands);
+  }
+}
+
+// Job helping the caller of gcgParallelRows(). The reference is released in the destructor
+// because the pool deletes discarded jobs without calling run().
+class gcgROWBANDSJOB : public gcgJOB {
+  public:
+    GCG_ROWBANDS *bands;
+
+  public:
+    gcgROWBANDSJOB(GCG_ROWBANDS *_bands) { this->bands = _bands; }
+    virtual ~gcgROWBANDSJOB() { releaseRowBands(this->bands); }
+    virtual void run() { processRowBands(this->bands); }
+};
+
+// Pool shared by all internal filters. It lives until the process ends.
+static pthread_mutex_t rowbandsmutex = PTHREAD_MUTEX_INITIALIZER;
+static gcgTHREADPOOL   *rowbandspool = NULL;
+static unsigned int    rowbandsthreads = 0;
+
+static gcgTHREADPOOL *getRowBandsPool(unsigned int *nthreads) {
+  pthread_mutex_lock(&rowbandsmutex);
+    if(rowbandspool == NULL) {
+      rowbandsthreads = gcgGetNumberOfProcessors();
+      if(rowbandsthreads > 1) {
+        rowbandspool = new gcgTHREADPOOL(rowbandsthreads - 1); // The caller is also a worker
+        if(rowbandspool != NULL && rowbandspool->getNumberOfThreads() == 0) SAFE_DELETE(rowbandspool);
+      }
+      if(rowbandspool == NULL) rowbandsthreads = 1;
+    }
+    *nthreads = rowbandsthreads;
+  pthread_mutex_unlock(&rowbandsmutex);
+  return rowbandspool;
+}
+
+// Calls kernel for bands of at least minrows rows covering [0, nrows)
+void gcgParallelRows(GCG_ROWSKERNEL kernel, void *args, unsigned int nrows, unsigned int minrows) {
+  if(minrows == 0) minrows = 1;
+
+  // Small images are not worth the synchronization
+  unsigned int nthreads = 1;
+  gcgTHREADPOOL *pool = (nrows >= 2 * minrows) ? getRowBandsPool(&nthreads) : NULL;
+  if(pool == NULL || nthreads < 2) {
+    kernel(args, 0, nrows);
+    return;
+  }
+
+  // Some extra bands balance the load when threads are shared with other jobs
+  unsigned int nbands = MIN(nrows / minrows, 4 * nthreads);
+  unsigned int njobs  = MIN(nbands, nthreads) - 1;
+
+  GCG_ROWBANDS *bands = (GCG_ROWBANDS*) ALLOC(sizeof(GCG_ROWBANDS));
+  if(bands == NULL) {
+    kernel(args, 0, nrows);
+    return;
+  }
+  if(pthread_mutex_init(&bands->mutex, NULL) != 0) {
+    FREE(bands);
+    kernel(args, 0, nrows);
+    return;
+  }
+  if(pthread_cond_init(&bands->donecond, NULL) != 0) {
+    pthread_mutex_destroy(&bands->mutex);
+    FREE(bands);
+    kernel(args, 0, nrows);
+    return;
+  }
+  bands->kernel = kernel;
+  bands->args = args;
+  bands->nrows = nrows;
+  bands->bandrows = (nrows + nbands - 1) / nbands;
+  bands->nextrow = 0;
+  bands->pendingrows = nrows;
+  bands->references = 1 + njobs;
+
+  // Jobs not assigned give their reference back
+  for(unsigned int i = 0; i < njobs; i++) {
+    gcgROWBANDSJOB *job = new gcgROWBANDSJOB(bands);
+    if(job == NULL) releaseRowBands(bands);
+    else if(!pool->assignJob(job)) delete job;
+  }
+
+  // The caller works too: a busy pool or a call from inside a job never blocks
+  processRowBands(bands);
+
+  // Wait bands claimed by the jobs
+  pthread_mutex_lock(&bands->mutex);
+    while(bands->pendingrows > 0) pthread_cond_wait(&bands->donecond, &bands->mutex);
+  pthread_mutex_unlock(&bands->mutex);
+
+  releaseRowBands(bands);
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//Stage instrumentation: scoped timers, counters and a latency histogram for
+//every pipeline stage, shared by all the threads. It is off unless
+//main_instrument is set; when off a scope costs one branch and nothing is
+//counted. The wall time of a stage is the sum over its scopes (several threads
+//add up), the cpu time that of the threads inside them. A stage includes the
+//ones nested in it (validate reads its own ground truth frames)
+enum InstrumentStage
+{
+	STAGE_DECODE,		//image and video frames
+	STAGE_RESIZE,
+	STAGE_FLOW,			//optical flow and gabor responses
+	STAGE_DESCRIBE,
+	STAGE_MATCH,
+	STAGE_VALIDATE,		//ground truth validation
+	STAGE_IO,			//flow, gabor and descriptor files
+	STAGE_COUNT
+};
+//______________________________________________________________________________
+//cpu seconds of the calling thread (windows counts in scheduler ticks) and of
+//the process, peak resident memory in bytes
+static double supp_thread_cpu_seconds()
+{
+#ifdef _WIN32
+	FILETIME	creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+		return 0;
+	ULARGE_INTEGER	k, u;
+	k.LowPart = kernel.dwLowDateTime;	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;		u.HighPart = user.dwHighDateTime;
+	return (double)(k.QuadPart + u.QuadPart) * 1e-7;
+#else
+	timespec	ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+static double supp_process_cpu_seconds()
+{
+#ifdef _WIN32
+	FILETIME	creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+		return 0;
+	ULARGE_INTEGER	k, u;
+	k.LowPart = kernel.dwLowDateTime;	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;		u.HighPart = user.dwHighDateTime;
+	return (double)(k.QuadPart + u.QuadPart) * 1e-7;
+#else
+	rusage	ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+		   (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+static double supp_peak_rss_bytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS	pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+	return (double)pmc.PeakWorkingSetSize;
+#else
+	rusage	ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss * 1024.0;
+#endif
+}
+//______________________________________________________________________________
+struct Instrumentation
+{
+	static const int	buckets = 24;	//latency bucket b counts [2^b, 2^(b+1)) us, 0 from 0
+	struct Stage
+	{
+		std::atomic<long long>	calls,
+								wallNs,
+								cpuNs,
+								items,
+								bytesRead,
+								bytesWritten,
+								latency[buckets];
+	};
+
+	std::atomic<bool>						_enabled;
+	Stage									_stages[STAGE_COUNT];
+	std::chrono::steady_clock::time_point	_start;
+	double									_cpuStart = 0;
+
+	Instrumentation() : _enabled(false){ reset(); }
+
+	bool	enabled() const { return _enabled.load(std::memory_order_relaxed); }
+	//clears the counters and starts counting.....................................
+	void start()
+	{
+		reset();
+		_start		= std::chrono::steady_clock::now();
+		_cpuStart	= supp_process_cpu_seconds();
+		_enabled	= true;
+	}
+	void reset()
+	{
+		for (auto & st : _stages){
+			st.calls = 0;	st.wallNs = 0;	st.cpuNs = 0;
+			st.items = 0;	st.bytesRead = 0;	st.bytesWritten = 0;
+			for (auto & b : st.latency)
+				b = 0;
+		}
+	}
+	static const char * name(int stage)
+	{
+		static const char * names[STAGE_COUNT] =
+			{ "decode", "resize", "flow", "describe", "match", "validate", "io" };
+		return names[stage];
+	}
+	//one finished scope.........................................................
+	void record(int stage, long long wallNs, long long cpuNs)
+	{
+		Stage &	st = _stages[stage];
+		st.calls++;
+		st.wallNs += wallNs;
+		st.cpuNs  += cpuNs;
+		int		b = 0;
+		for (long long us = wallNs / 1000; us > 1 && b < buckets - 1; us >>= 1)
+			b++;
+		st.latency[b]++;
+	}
+	void count(int stage, long long items)
+	{
+		if (enabled()) _stages[stage].items += items;
+	}
+	void read(int stage, long long bytes)
+	{
+		if (enabled()) _stages[stage].bytesRead += bytes;
+	}
+	void written(int stage, long long bytes)
+	{
+		if (enabled()) _stages[stage].bytesWritten += bytes;
+	}
+	//bytes of a file that was read or written, one metadata call (the file is
+	//not opened) and only when enabled...........................................
+	static long long fileSize(const std::string & file)
+	{
+#ifdef _WIN32
+		WIN32_FILE_ATTRIBUTE_DATA	data;
+		if (!GetFileAttributesExA(file.c_str(), GetFileExInfoStandard, &data))
+			return 0;
+		return ((long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+#else
+		struct stat	st;
+		return stat(file.c_str(), &st) == 0 ? (long long)st.st_size : 0;
+#endif
+	}
+	void readFile(int stage, const std::string & file)
+	{
+		if (enabled()) _stages[stage].bytesRead += fileSize(file);
+	}
+	void writtenFile(int stage, const std::string & file)
+	{
+		if (enabled()) _stages[stage].bytesWritten += fileSize(file);
+	}
+	//______________________________________________________________________________
+	//json when the file ends in .json, csv otherwise (stdout when empty); the
+	//last csv row is the whole run
+	void report(const std::string & file)
+	{
+		double	wall	= std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count(),
+				cpu		= supp_process_cpu_seconds() - _cpuStart,
+				rss		= supp_peak_rss_bytes();
+		bool	json	= file.size() > 5 && file.compare(file.size() - 5, 5, ".json") == 0;
+		std::ofstream	out;
+		if (file.size())
+			out.open(file);
+		std::ostream &	os = file.size() ? out : std::cout;
+		if (!os){
+			std::cout << "cannot write " << file << std::endl;
+			return;
+		}
+		os.precision(9);
+		if (json)
+			os << "{\"wall_s\": " << wall << ", \"cpu_s\": " << cpu
+			   << ", \"peak_rss_bytes\": " << rss << ",\n \"stages\": [\n";
+		else
+			os << "stage,calls,wall_s,cpu_s,items,items_per_s,bytes_read,bytes_written,latency_log2_us\n";
+		for (int s = 0; s < STAGE_COUNT; ++s){
+			Stage &	st		= _stages[s];
+			double	stWall	= st.wallNs * 1e-9,
+					rate	= stWall > 0 ? st.items / stWall : 0;
+			if (json){
+				os << "  {\"stage\": \"" << name(s) << "\", \"calls\": " << st.calls
+				   << ", \"wall_s\": " << stWall << ", \"cpu_s\": " << st.cpuNs * 1e-9
+				   << ", \"items\": " << st.items << ", \"items_per_s\": " << rate
+				   << ", \"bytes_read\": " << st.bytesRead
+				   << ", \"bytes_written\": " << st.bytesWritten << ", \"latency_log2_us\": [";
+				for (int b = 0; b < buckets; ++b)
+					os << (b ? ", " : "") << st.latency[b];
+				os << "]}" << (s + 1 < STAGE_COUNT ? ",\n" : "\n");
+			}
+			else{
+				os << name(s) << "," << st.calls << "," << stWall << "," << st.cpuNs * 1e-9
+				   << "," << st.items << "," << rate << "," << st.bytesRead << ","
+				   << st.bytesWritten << ",";
+				for (int b = 0; b < buckets; ++b)
+					os << (b ? " " : "") << st.latency[b];
+				os << "\n";
+			}
+		}
+		if (json)
+			os << " ]}\n";
+		else
+			os << "total,," << wall << "," << cpu << ",,,,,peak_rss_bytes " << rss << "\n";
+	}
+};
+//______________________________________________________________________________
+//the instance shared by the whole process.......................................
+static Instrumentation & supp_instrument()
+{
+	static Instrumentation	instrument;
+	return instrument;
+}
+//______________________________________________________________________________
+//scoped timer of a stage, does nothing when the instrumentation is off.........
+struct InstrumentScope
+{
+	int										_stage;
+	bool									_on;
+	std::chrono::steady_clock::time_point	_wall;
+	double									_cpu = 0;
+
+	InstrumentScope(int stage) : _stage(stage), _on(supp_instrument().enabled())
+	{
+		if (_on){
+			_wall	= std::chrono::steady_clock::now();
+			_cpu	= supp_thread_cpu_seconds();
+		}
+	}
+	~InstrumentScope()
+	{
+		if (!_on)
+			return;
+		long long	wall	= std::chrono::duration_cast<std::chrono::nanoseconds>(
+								std::chrono::steady_clock::now() - _wall).count(),
+					cpu		= (long long)((supp_thread_cpu_seconds() - _cpu) * 1e9);
+		supp_instrument().record(_stage, wall, cpu);
+	}
+};
+//same for one expression, keeps its result: Mat img = supp_timed(STAGE_DECODE,
+//[&]{ return imread(file); });
+template <class F>
+auto supp_timed(int stage, F f) -> decltype(f())
+{
+	InstrumentScope	scope(stage);
+	return f();
+}
@@ -51,6 +51,7 @@
 		M45.create(this->nbins, this->nbins);
 		M90.create(this->nbins, this->nbins);
 		M135.create(this->nbins, this->nbins);
+		counts.resize(4 * this->nbins * this->nbins);
 	}
 
 	CoOccurrenceGeneral::~CoOccurrenceGeneral() {
@@ -66,6 +67,7 @@
 		M45 = descriptor.M45.clone();
 		M90 = descriptor.M90.clone();
 		M135 = descriptor.M135.clone();
+		counts.resize(4 * this->nbins * this->nbins);
 
 	}
 
@@ -100,6 +102,7 @@
 		M90.create(this->nbins, this->nbins);
 		M135.release();
 		M135.create(this->nbins, this->nbins);
+		counts.resize(4 * this->nbins * this->nbins);
 	}
 
 	void CoOccurrenceGeneral::setDistance(const int distance) {
@@ -269,18 +272,67 @@
 	}
 
 	void CoOccurrenceGeneral::extractAllMatricesDirections(const cv::Rect& patch, cv::Mat_<int> &img, std::vector<cv::Mat>& output) {
+		int R[4] = { 0, 0, 0, 0 };
+		int d, n, x, y;
 
-		cv::Mat dummy; //testar se vai precisar declarar o tamanho
+		/* Inicializacoes */
+		d = this->distance;
+		n = this->nbins;
+		int *C0 = &counts[0], *C45 = C0 + n * n, *C90 = C45 + n * n, *C135 = C90 + n * n;
+		std::fill(counts.begin(), counts.end(), 0);
 
-		extractMatrix0(patch, img, dummy);
-		extractMatrix45(patch, img, dummy);
-		extractMatrix90(patch, img, dummy);
-		extractMatrix135(patch, img, dummy);
+		/* Same pairs as extractMatrix0/45/90/135, counted in a single scan */
+		for (int row = patch.y; row < patch.height; row++) {
+			const int *current = img[row];
+			const int *below = (row + d < patch.height) ? img[row + d] : NULL;
 
-		output.push_back(M0);
-		output.push_back(M45);
-		output.push_back(M90);
-		output.push_back(M135);
+			for (int col = patch.x; col < patch.width; col++) {
+				x = current[col];
+				if (x == -1)
+					continue;
 
+				if (col + d < patch.width && (y = current[col + d]) != -1) {
+					C0[y * n + x]++;
+					C0[x * n + y]++;
+					R[0]++;
+				}
+
+				if (below == NULL)
+					continue;
+
+				if (col - d >= patch.x && (y = below[col - d]) != -1) {
+					C45[y * n + x]++;
+					C45[x * n + y]++;
+					R[1]++;
+				}
+
+				if ((y = below[col]) != -1) {
+					C90[y * n + x]++;
+					C90[x * n + y]++;
+					R[2]++;
+				}
+
+				if (col + d < patch.width && (y = below[col + d]) != -1) {
+					C135[y * n + x]++;
+					C135[x * n + y]++;
+					R[3]++;
+				}
+			}
+		}
+
+		/* Normalizes in new matrices: the outputs do not share data */
+		cv::Mat_<float> *M[4] = { &M0, &M45, &M90, &M135 };
+		for (int k = 0; k < 4; k++) {
+			float scale = static_cast<float>(1.0 / ((R[k] == 0) ? 1 : R[k]));
+			const int *C = &counts[k * n * n];
+
+			cv::Mat_<float> m(n, n);
+			float *data = m[0];
+			for (int i = 0; i < n * n; i++)
+				data[i] = C[i] * scale;
+
+			*M[k] = m;
+			output.push_back(m);
+		}
 	}
 
@@ -55,6 +55,8 @@
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <vector>
 
 
 typedef unsigned short gray;
@@ -67,6 +69,7 @@ private:
 	int distance;
 
 	cv::Mat_<float> M0, M45, M90, M135;
+	std::vector<int> counts; //scratch of extractAllMatricesDirections(): 4 direction matrices of bin counts
 	float **matrix(int nrl, int nrh, int ncl, int nch);
 	float *cvector(int nl, int nh);
 
@@ -98,6 +101,7 @@ private:
 	void extractMatrix90(const cv::Rect& patch, cv::Mat_<int> &img, cv::Mat& output);
 	void extractMatrix135(const cv::Rect& patch, cv::Mat_<int> &img, cv::Mat& output);
 
+	//one pass for the 4 directions, appends new matrices 0, 45, 90 and 135 to output
 	void extractAllMatricesDirections(const cv::Rect& patch, cv::Mat_<int> &img, std::vector<cv::Mat>& output);
 };
 
@@ -58,7 +58,7 @@ void DescriptorTemporal::extract(cv::Mat& output) {
 		beforeProcess();
 		mIsPrepared = true;
 	}
-	extractFeatures(Cube(0, 0, 0, mImages[0].cols, mImages[0].rows, static_cast<int>(mImages.size())), output);
+	extractFeatures(Cube(0, 0, 0, mImages[0].rows, mImages[0].cols, static_cast<int>(mImages.size())), output);
 }
 
 void DescriptorTemporal::extract(const std::vector<Cube>& cuboids, cv::Mat& output) {
@@ -69,19 +69,95 @@ void DescriptorTemporal::extract(const std::vector<Cube>& cuboids, cv::Mat& outp
 	for (auto& cuboid : cuboids) {
 		cv::Mat feat;
 
-		auto cuboidRoi = Cube(0, 0, 0, mImages[0].cols, mImages[0].rows, static_cast<int>(mImages.size()));
-		auto intersection = cuboidRoi & cuboid;
-
-		if (intersection != cuboid) {
-			std::runtime_error(
-				"Invalid cuboid, its intersection with the images are" +
-				std::string("different than the cuboid itself"));
-		}
+		checkCuboid(cuboid);
 		extractFeatures(cuboid, feat);
 		output.push_back(feat);
 	}
 }
 
+void DescriptorTemporal::extractParallel(const std::vector<Cube>& cuboids, cv::Mat& output, int numThreads,
+	std::vector<int>* rowCuboids) {
+	if (!mIsPrepared) {
+		beforeProcess();
+		mIsPrepared = true;
+	}
+	output.release();
+	if (rowCuboids)
+		rowCuboids->clear();
+	if (cuboids.empty())
+		return;
+
+	int length = getDescriptorLength(cuboids.front());
+	for (auto& cuboid : cuboids) {
+		checkCuboid(cuboid);
+		if (getDescriptorLength(cuboid) != length)
+			throw std::runtime_error("Invalid cuboid, its descriptor length is different from the others");
+	}
+
+	if (numThreads <= 0)
+		numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	numThreads = std::min(numThreads, static_cast<int>(cuboids.size()));
+	setNumWorkers(numThreads);
+
+	//each worker fills the rows of the cuboids it takes
+	cv::Mat features(static_cast<int>(cuboids.size()), length, CV_32F);
+	std::vector<char> described(cuboids.size(), 0);
+	std::vector<std::exception_ptr> errors(numThreads);
+	std::atomic<int> next(0);
+	auto worker = [&](int w) {
+		try {
+			for (int i = next++; i < static_cast<int>(cuboids.size()); i = next++) {
+				cv::Mat row = features.row(i);
+				extractFeatures(cuboids[i], row, w);
+				if (!row.empty()) {
+					if (row.data != features.ptr(i))
+						throw std::runtime_error("Invalid cuboid, its features were not written in place");
+					described[i] = 1;
+				}
+			}
+		}
+		catch (...) {
+			errors[w] = std::current_exception();
+			next = static_cast<int>(cuboids.size());
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int w = 1; w < numThreads; w++)
+		threads.push_back(std::thread(worker, w));
+	worker(0);
+	for (auto &th : threads)
+		th.join();
+	for (auto &e : errors)
+		if (e)
+			std::rethrow_exception(e);
+
+	//cuboids without features are left out, as extract() does
+	int rows = 0;
+	for (int i = 0; i < static_cast<int>(cuboids.size()); i++)
+		if (described[i]) {
+			if (rows != i)
+				features.row(i).copyTo(features.row(rows));
+			if (rowCuboids)
+				rowCuboids->push_back(i);
+			rows++;
+		}
+	if (rows > 0)
+		output = features.rowRange(0, rows);
+}
+
+void DescriptorTemporal::checkCuboid(const Cube& cuboid) const {
+	//x0 and w run along the rows and y0 and h along the columns, as OFCM::CreatePatch reads them
+	auto cuboidRoi = Cube(0, 0, 0, mImages[0].rows, mImages[0].cols, static_cast<int>(mImages.size()));
+	auto intersection = cuboidRoi & cuboid;
+
+	if (intersection != cuboid) {
+		throw std::runtime_error(
+			"Invalid cuboid, its intersection with the images are" +
+			std::string("different than the cuboid itself"));
+	}
+}
+
 /*
 void DescriptorTemporal::extract(const std::vector<cv::KeyPoint>& keypoints, cv::Mat& output) {
 	//TODO
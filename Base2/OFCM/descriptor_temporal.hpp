@@ -44,6 +44,11 @@
 
 
 #include <opencv2/core.hpp>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
 
@@ -58,10 +63,19 @@ class DescriptorTemporal {
 
 	void extract(cv::Mat& output);
 	void extract(const std::vector<Cube>& cuboids,	cv::Mat& output);
+	//Same result as extract(cuboids, output). The output is allocated once and the
+	//cuboids are shared by numThreads workers (0: one per core) filling their own rows.
+	//If rowCuboids is given, it receives the index in cuboids of each output row
+	void extractParallel(const std::vector<Cube>& cuboids, cv::Mat& output, int numThreads = 0,
+		std::vector<int>* rowCuboids = nullptr);
 	//TODO
 	//DESCRIPTORS_EXPORT void extract(const std::vector<cv::KeyPoint>& keypoints,	cv::Mat& output);
 	
 	void setData(const std::vector<cv::Mat>& imgs);
+	int getNumImages() const { return static_cast<int>(mImages.size()); }
+
+	//Features of a cuboid have getDescriptorLength() columns
+	virtual int getDescriptorLength(const Cube& cuboid) const = 0;
 
 
 
@@ -69,6 +83,13 @@ class DescriptorTemporal {
 	 virtual void beforeProcess() = 0;
 	 virtual void extractFeatures(const Cube& cuboid, cv::Mat& output) = 0;
 
+	 //Parallel extraction: each worker calls extractFeatures() with its index, so it
+	 //can use its own scratch. A preallocated row given as output must be filled in place
+	 virtual void setNumWorkers(int numWorkers) = 0;
+	 virtual void extractFeatures(const Cube& cuboid, cv::Mat& output, int worker) = 0;
+
+	 void checkCuboid(const Cube& cuboid) const;
+
 	 std::vector<cv::Mat> mImages;
 	 bool mIsPrepared = false;
 };
@@ -41,6 +41,9 @@
 
 #include "haralick.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <vector>
 
 
@@ -70,35 +73,128 @@ cv::Mat Haralick::compute(const cv::Mat& mat) {
   return output;
 }
 
+namespace {
+
+// Fused kernel for the 12 "old" features. The matrix is scanned once to build
+// the marginal, p_{x+y} and p_{x-y} distributions together with the sums that
+// need the full matrix (ASM, correlation, IDM, entropy, directionality); the
+// remaining moments come from a second pass over those short vectors.
+// N > 0 fixes the number of bins at compile time so the loops can be unrolled;
+// N == 0 is the generic version that reads the size from n.
+template <int N>
+void haralickOld(const cv::Mat& mat, int n, float* output) {
+	const int rows = N > 0 ? N : n;
+	const int cols = rows;
+	const float eps = static_cast<float>(HARALICK_EPSILON);
+
+	float pxFixed[N > 0 ? N : 1], pSumFixed[N > 0 ? 2 * N + 1 : 1], pDiffFixed[N > 0 ? 2 * N + 1 : 1];
+	std::vector<float> buffer;
+	float *px = pxFixed, *pSum = pSumFixed, *pDiff = pDiffFixed;
+	if (N == 0) {
+		buffer.assign(rows + 2 * (rows + cols + 1), 0.0f);
+		px = &buffer[0];
+		pSum = px + rows;
+		pDiff = pSum + rows + cols + 1;
+	}
+	else {
+		std::fill(px, px + rows, 0.0f);
+		std::fill(pSum, pSum + rows + cols + 1, 0.0f);
+		std::fill(pDiff, pDiff + rows + cols + 1, 0.0f);
+	}
+
+	float asm_ = 0.0f, ijSum = 0.0f, iSum = 0.0f, idm = 0.0f, entropy = 0.0f, trace = 0.0f;
+	for (int i = 0; i < rows; ++i) {
+		const float* m = mat.ptr<float>(i);
+		for (int j = 0; j < cols; ++j) {
+			const float v = m[j];
+			asm_ += v * v;
+			px[i] += v;
+			ijSum += i * j * v;
+			iSum += i * v;
+			idm += v / (1 + (i - j) * (i - j));
+			pSum[i + j + 2] += v;
+			pDiff[std::abs(i - j)] += v;
+			entropy += v * log10(v + eps);
+		}
+		trace += m[i];
+	}
+
+	float contrast = 0.0f;
+	for (int k = 0; k < rows; ++k)
+		contrast += k * k * pDiff[k];
+
+	// correlation (the matrix is symmetric, so x and y statistics match)
+	float meanX = 0.0f, sumSqrX = 0.0f;
+	for (int i = 0; i < rows; ++i) {
+		meanX += px[i] * i;
+		sumSqrX += px[i] * i * i;
+	}
+	float stdDevX = std::sqrt(sumSqrX - (meanX * meanX)) + eps;
+	float correlation = (ijSum - meanX * meanX) / (stdDevX * stdDevX);
+
+	float variance = 0.0f;
+	for (int i = 0; i < rows; ++i)
+		variance += (i + 1 - iSum) * (i + 1 - iSum) * px[i];
+
+	float sumAvg = 0.0f, sumEntropy = 0.0f;
+	for (int k = 2; k <= rows + cols; ++k) {
+		sumAvg += k * pSum[k];
+		sumEntropy += pSum[k] * log10(pSum[k] + eps);
+	}
+	float sumVariance = 0.0f;
+	for (int k = 2; k <= rows + cols; ++k)
+		sumVariance += (k - sumAvg) * (k - sumAvg) * pSum[k];
+
+	float diffSum = 0.0f, diffSumSqr = 0.0f, diffEntropy = 0.0f;
+	for (int k = 0; k < rows; ++k) {
+		diffSum += pDiff[k];
+		diffSumSqr += pDiff[k] * pDiff[k];
+		diffEntropy += pDiff[k] * log10(pDiff[k] + eps);
+	}
+	float tmp = static_cast<float>(rows * cols);
+
+	output[0] = asm_;
+	output[1] = contrast;
+	output[2] = correlation;
+	output[3] = variance;
+	output[4] = idm;
+	output[5] = sumAvg;
+	output[6] = sumVariance;
+	output[7] = -sumEntropy;
+	output[8] = -entropy;
+	output[9] = ((tmp * diffSumSqr) - (diffSum * diffSum)) / (tmp * tmp);
+	output[10] = -diffEntropy;
+	output[11] = trace;
+
+	for (int i = 0; i < Haralick::numOldFeatures; i++)
+		if (isnan(output[i])) output[i] = 0.0f;
+}
+
+}
+
 cv::Mat Haralick::computeOld(const cv::Mat& mat) {
 	//Compute just 12 features (old implementaion from William Schwartz)
-	cv::Mat output = cv::Mat::zeros(1, 12, CV_32F);
-
-	output.at<float>(0, 0) = Haralick::f1ASM(mat);
-	output.at<float>(0, 1) = Haralick::f2Contrast(mat);
-	output.at<float>(0, 2) = Haralick::f3Correlation(mat);
-	output.at<float>(0, 3) = Haralick::f4Variance(mat);
-	output.at<float>(0, 4) = Haralick::f5IDM(mat);
-	output.at<float>(0, 5) = Haralick::f6SumAverage(mat);
-	output.at<float>(0, 6) = Haralick::f7SumVariance(mat);
-	output.at<float>(0, 7) = Haralick::f8SumEntropy(mat);
-	output.at<float>(0, 8) = Haralick::f9Entropy(mat);
-	output.at<float>(0, 9) = Haralick::f10DifferenceVariance(mat);
-	output.at<float>(0, 10) = Haralick::f11DifferenceEntropy(mat);
-	//output.at<float>(0, 11) = Haralick::f12InformationCorrelation01(mat);
-	//output.at<float>(0, 12) = Haralick::f13InformationCorrelation02(mat);
-	//output.at<float>(0, 13) = 0.0f;
-	output.at<float>(0, 11) = Haralick::f15_Dierctionality(mat);
-
-  for (int i = 0; i < 12; i++)
-  {
-    auto a = output.at<float>(0, i);
-    if (isnan(a)) output.at<float>(0, i) = 0.0f;
-  }
-
+	cv::Mat output = cv::Mat::zeros(1, numOldFeatures, CV_32F);
+	computeOld(mat, output.ptr<float>(0));
 	return output;
 }
 
+void Haralick::computeOld(const cv::Mat& mat, float* output) {
+	CV_Assert(mat.type() == CV_32F && mat.rows == mat.cols);
+
+	switch (mat.rows) {
+	case 4: haralickOld<4>(mat, 4, output); break;
+	case 8: haralickOld<8>(mat, 8, output); break;
+	case 16: haralickOld<16>(mat, 16, output); break;
+	default: haralickOld<0>(mat, mat.rows, output); break;
+	}
+}
+
+void Haralick::computeOld(const std::vector<cv::Mat>& mats, float* output) {
+	for (size_t i = 0; i < mats.size(); i++)
+		computeOld(mats[i], output + numOldFeatures * i);
+}
+
 float Haralick::f1ASM(const cv::Mat& mat) {
   float sum = 0.0;
 
@@ -44,6 +44,8 @@
 
 #include <opencv2/core.hpp>
 
+#include <vector>
+
 #define HARALICK_EPSILON 0.00001
 
 
@@ -54,6 +56,16 @@ class Haralick {
 	//Compute just 12 features (old implementaion from William Schwartz)
 	static cv::Mat computeOld(const cv::Mat& mat);
 
+	// Same 12 features written to output[0..11], computed in a single pass
+	// over the matrix. Square CV_32F matrices of 4, 8 or 16 bins use
+	// fixed-size kernels; any other size takes the generic path
+	static void computeOld(const cv::Mat& mat, float* output);
+
+	// Batched version: the features of mats[i] go to output[12 * i .. 12 * i + 11]
+	static void computeOld(const std::vector<cv::Mat>& mats, float* output);
+
+	static const int numOldFeatures = 12;
+
  private:
   static float f1ASM(const cv::Mat& mat);
   static float f2Contrast(const cv::Mat& mat);
@@ -0,0 +1,103 @@
+#include "moving_points.hpp"
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+  #include <intrin.h>
+#endif
+
+namespace {
+
+inline int popcount16(unsigned v) {
+	v = v - ((v >> 1) & 0x5555);
+	v = (v & 0x3333) + ((v >> 2) & 0x3333);
+	v = (v + (v >> 4)) & 0x0F0F;
+	return (v + (v >> 8)) & 0x1F;
+}
+
+inline int lowestBit(unsigned v) {
+#ifdef _MSC_VER
+	unsigned long b;
+	_BitScanForward(&b, v);
+	return static_cast<int>(b);
+#else
+	return __builtin_ctz(v);
+#endif
+}
+
+}
+
+void MovingPoints::rowBits(const uchar* d, const uchar* m, int cols, uint16_t* out) const {
+	const uchar* k = keepCols.empty() ? nullptr : keepCols.data();
+	int words = (cols + 15) / 16;
+	int w = 0;
+#ifdef MOVING_POINTS_SSE2
+	// d > thr is max(d, thr + 1) == d, unsigned
+	const __m128i vMin = _mm_set1_epi8(static_cast<char>(std::max(thr + 1, 0))),
+		vZero = _mm_setzero_si128();
+	for (; 16 * (w + 1) <= cols; w++) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + 16 * w));
+		__m128i moving = _mm_cmpeq_epi8(_mm_max_epu8(v, vMin), v);
+		if (m)
+			moving = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m + 16 * w)), vZero), moving);
+		if (k)
+			moving = _mm_and_si128(moving, _mm_loadu_si128(reinterpret_cast<const __m128i*>(k + 16 * w)));
+		out[w] = static_cast<uint16_t>(_mm_movemask_epi8(moving));
+	}
+#endif
+	for (; w < words; w++) {
+		unsigned word = 0;
+		for (int j = 16 * w, b = 0; j < cols && b < 16; j++, b++)
+			if (d[j] > thr && (!m || m[j]) && (!k || k[j]))
+				word |= 1u << b;
+		out[w] = static_cast<uint16_t>(word);
+	}
+}
+
+void MovingPoints::extract(const cv::Mat& diff, std::vector<cv::Point2f>& points, const cv::Mat& mask) {
+	CV_Assert(diff.type() == CV_8UC1);
+	CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == diff.size()));
+	points.clear();
+	if (diff.empty() || thr >= 255)
+		return;
+
+	int rows = diff.rows, cols = diff.cols, words = (cols + 15) / 16;
+	int step = std::max(stride, 1);
+	keepCols.clear();
+	if (step > 1) {
+		keepCols.assign(cols, 0);
+		for (int j = 0; j < cols; j += step)
+			keepCols[j] = 0xFF;
+	}
+
+	// moving pixels of the kept rows and their count
+	bits.resize(static_cast<size_t>(rows) * words);
+	size_t total = 0;
+	for (int i = 0; i < rows; i += step) {
+		uint16_t* out = bits.data() + static_cast<size_t>(i) * words;
+		rowBits(diff.ptr<uchar>(i), mask.empty() ? nullptr : mask.ptr<uchar>(i), cols, out);
+		for (int w = 0; w < words; w++)
+			total += popcount16(out[w]);
+	}
+
+	// coordinates of the set bits, in raster order
+	points.resize(total);
+	cv::Point2f* p = points.data();
+	bool capped = cellSize > 0 && cellCap > 0;
+	int band = -1;
+	for (int i = 0; i < rows; i += step) {
+		if (capped && i / cellSize != band) {
+			band = i / cellSize;
+			cellCounts.assign((cols + cellSize - 1) / cellSize, 0);
+		}
+		const uint16_t* in = bits.data() + static_cast<size_t>(i) * words;
+		for (int w = 0; w < words; w++)
+			for (unsigned word = in[w]; word; word &= word - 1) {
+				int j = 16 * w + lowestBit(word);
+				if (capped && cellCounts[j / cellSize]++ >= cellCap)
+					continue;
+				*p++ = cv::Point2f(static_cast<float>(j), static_cast<float>(i));
+			}
+	}
+	points.resize(p - points.data());
+}
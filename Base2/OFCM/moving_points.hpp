@@ -0,0 +1,44 @@
+#ifndef _SSIG_DESCRIPTORS_MOVING_POINTS_HPP_
+#define _SSIG_DESCRIPTORS_MOVING_POINTS_HPP_
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define MOVING_POINTS_SSE2
+#endif
+
+// Points to track of a pair of frames: the pixels of their gray difference over
+// thr. The pixels are compared 16 at a time into one bit each, the bits are
+// counted so the output is sized once, and then expanded into coordinates; the
+// buffers are kept between calls, so an instance is used by one thread at a time.
+// The density can be bounded: stride > 1 keeps one pixel of every stride x stride
+// block, cellCap > 0 keeps the first cellCap points (raster order) of every
+// cellSize x cellSize cell
+class MovingPoints {
+ public:
+	int thr = 30;
+	int stride = 1;
+	int cellSize = 0;
+	int cellCap = 0;
+
+	MovingPoints() {}
+	MovingPoints(int thr, int stride = 1, int cellSize = 0, int cellCap = 0)
+		: thr(thr), stride(stride), cellSize(cellSize), cellCap(cellCap) {}
+
+	// diff is CV_8UC1; the mask, when given, is CV_8UC1 of the same size and
+	// only its nonzero pixels are kept
+	void extract(const cv::Mat& diff, std::vector<cv::Point2f>& points, const cv::Mat& mask = cv::Mat());
+
+ private:
+	std::vector<uint16_t> bits; // moving pixels of the frame, 16 per word
+	std::vector<uchar> keepCols; // 0xFF in the columns kept by the stride
+	std::vector<int> cellCounts; // points of the cells of the current row of cells
+
+	void rowBits(const uchar* d, const uchar* m, int cols, uint16_t* out) const;
+};
+
+#endif  // !_SSIG_DESCRIPTORS_MOVING_POINTS_HPP_
@@ -83,10 +83,6 @@ OFCM::OFCM(int nBinsMagnitude, int nBinsAngle, int distanceMagnitude, int distan
 	
 	this->maxAngle = 361.0; //max val of Angle is 360. We sum 1 more to fit on nBinsAngle. If 360 / (360 / 4) it will go to the bin 4, but it is from 0 to 3. (int)floor(angle / (this->maxAngle / this->nBinsAngle));
 	//extractionType = 0;
-
-	this->coocMagnitude = NULL;
-	this->coocAngles = NULL;
-	this->mapToOpticalFlows = NULL;
 }
 
 OFCM::~OFCM() {
@@ -97,17 +93,13 @@ OFCM::~OFCM() {
 		this->data[i].second.release();
 	}
 	this->data.clear();
+	this->movingPixels.clear();
 
-	if (this->coocMagnitude != NULL)
-		delete this->coocMagnitude;
-
-	if (this->coocAngles != NULL)
-		delete this->coocAngles;
-
-	for (int i = 0; i < numImgs; i++)
-		delete[] this->mapToOpticalFlows[i];
-	delete[] this->mapToOpticalFlows;
+	for (auto cooc : this->coocMagnitude)
+		delete cooc;
 
+	for (auto cooc : this->coocAngles)
+		delete cooc;
 }
 
 OFCM::OFCM(const OFCM& rhs) {
@@ -121,85 +113,242 @@ OFCM& OFCM::operator=(const OFCM& rhs) {
   return *this;
 }
 
+void OFCM::setPointSampling(int stride, int cellSize, int cellCap) {
+	this->movingPoints.stride = stride;
+	this->movingPoints.cellSize = cellSize;
+	this->movingPoints.cellCap = cellCap;
+}
+
 void OFCM::beforeProcess() {
 	setParameters();
 	setOpticalFlowData();
 }
 
 void OFCM::extractFeatures(const Cube& cuboid, cv::Mat& output) {
-	bool is_verbose = false;
+	extractFeatures(cuboid, output, 0);
+}
+
+int OFCM::getDescriptorLength(const Cube& cuboid) const {
+	return ((4 * 12) + (4 * 12)) * calcNumOptcialFlowPerCuboid(cuboid.l);
+}
+
+void OFCM::setNumWorkers(int numWorkers) {
+	while (static_cast<int>(coocMagnitude.size()) < numWorkers)
+	{
+		coocMagnitude.push_back(new CoOccurrenceGeneral(this->nBinsMagnitude, this->distanceMagnitude));
+		coocAngles.push_back(new CoOccurrenceGeneral(this->nBinsAngle, this->distanceAngle));
+	}
+}
+
+void OFCM::extractFeatures(const Cube& cuboid, cv::Mat& output, int worker) {
 	bool hasMovement = !movementFilter; //false to eliminate pacthes without movement
 	std::deque<ParMat> patches;
 	patches = CreatePatch(cuboid, hasMovement);
-	output.release();
 
 	if (hasMovement) //verificar se tem movimento
 	{
+		//a preallocated row of the right size is kept and filled in place
+		output.create(1, ((4 * 12) + (4 * 12)) * static_cast<int>(patches.size()), CV_32F);
 		for (int i = 0, k = 0; i < patches.size(); i++)
 		{
 			std::vector<cv::Mat> mMagnitude, mAngles;
 
-			coocMagnitude->extractAllMatricesDirections(cv::Rect(0, 0, cuboid.w, cuboid.h), patches[i].second, mMagnitude);
-			coocAngles->extractAllMatricesDirections(cv::Rect(0, 0, cuboid.w, cuboid.h), patches[i].first, mAngles);
+			coocMagnitude[worker]->extractAllMatricesDirections(cv::Rect(0, 0, cuboid.w, cuboid.h), patches[i].second, mMagnitude);
+			coocAngles[worker]->extractAllMatricesDirections(cv::Rect(0, 0, cuboid.w, cuboid.h), patches[i].first, mAngles);
 			
-			for (cv::Mat &degreeMat : mMagnitude)
-				output.push_back(Haralick::computeOld(degreeMat));
-			
-			for (cv::Mat &degreeMat : mAngles)
-				output.push_back(Haralick::computeOld(degreeMat));
+			Haralick::computeOld(mMagnitude, output.ptr<float>(0) + k);
+			k += Haralick::numOldFeatures * static_cast<int>(mMagnitude.size());
+
+			Haralick::computeOld(mAngles, output.ptr<float>(0) + k);
+			k += Haralick::numOldFeatures * static_cast<int>(mAngles.size());
 			
 		}
-		output = output.reshape(0, 1);
 	}
+	else
+		output.release();
 	patches.clear();
 
 }
 
 /////////////////////////////////Aditional Auxiliary Functions//////////////////////////////////////
 void OFCM::setOpticalFlowData() {
+	this->numImgs = static_cast<int>(mImages.size());
+
+	// Pairs are independent: each one has its slot in data, and the frames are
+	// processed in chunks by several threads
 	data.clear();
-	std::vector<cv::Point2f> points[2], basePoints;
+	data.resize(setOpticalFlowTable());
+	movingPixels.clear();
+	movingPixels.resize(data.size());
+
+	const int chunkLength = 32;
+	int numChunks = (this->numImgs + chunkLength - 1) / chunkLength;
+	int numThreads = std::max(1, std::min(static_cast<int>(std::thread::hardware_concurrency()), numChunks));
+	std::vector<std::exception_ptr> errors(numThreads);
+	std::atomic<int> nextChunk(0);
+	auto worker = [&](int w) {
+		try {
+			for (int c = nextChunk++; c < numChunks; c = nextChunk++)
+				computeOpticalFlows(c * chunkLength, std::min((c + 1) * chunkLength, this->numImgs));
+		}
+		catch (...) {
+			errors[w] = std::current_exception();
+			nextChunk = numChunks;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int w = 1; w < numThreads; w++)
+		threads.push_back(std::thread(worker, w));
+	worker(0);
+	for (auto &th : threads)
+		th.join();
+	for (auto &e : errors)
+		if (e)
+			std::rethrow_exception(e);
+}
+
+int OFCM::setOpticalFlowTable() {
+	int numScales = static_cast<int>(this->temporalScales.size());
+	int numPairs = 0;
+
+	this->numTableFrames = this->numImgs;
+	this->streamOffset = 0;
+	this->mapToOpticalFlows.assign(this->numImgs * numScales, -1);
+	for (int i = 0; i < this->numImgs; i++)
+		for (int s = 0; s < numScales; s++)
+			if (i + this->temporalScales[s] < this->numImgs)
+				this->mapToOpticalFlows[i * numScales + s] = numPairs++;
+
+	return numPairs;
+}
+
+void OFCM::computeOpticalFlows(int firstFrame, int lastFrame) {
+	std::vector<cv::Point2f> points[2];
 	std::vector<uchar> status;
 	std::vector<float> err;
 	cv::Size winSize(31, 31);
 	cv::TermCriteria termcrit(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 20, 0.3);
-	int rows, cols;
+	int rows, cols, maxLevel = 3;
+	MovingPoints sampler = this->movingPoints; //its buffers are reused by the pairs of this chunk only
 
 	rows = mImages[0].rows;
 	cols = mImages[0].cols;
 
-	this->numImgs = static_cast<int>(mImages.size());
-	allocateMapToOpticalFlowsMatrix();
-
+	// Each frame is paired with the next ones at every temporal scale, so its pyramid
+	// is built once, the first time a pair with moving points reads it, and kept in a
+	// ring buffer while frames up to i + max(scale) are used
+	int maxScale = 0;
 	for (int t : this->temporalScales)
+		maxScale = std::max(maxScale, t);
+	std::vector<std::vector<cv::Mat>> pyramids(maxScale + 1);
+	std::vector<int> pyramidFrame(pyramids.size(), -1); // frame whose pyramid is in each slot
+	auto pyramid = [&](int f) -> std::vector<cv::Mat>& {
+		int slot = f % static_cast<int>(pyramids.size());
+		if (pyramidFrame[slot] != f) {
+			cv::buildOpticalFlowPyramid(mImages[f], pyramids[slot], winSize, maxLevel);
+			pyramidFrame[slot] = f;
+		}
+		return pyramids[slot];
+	};
+
+	for (int i = firstFrame; i < lastFrame; i++)
 	{
-		for (int i = 0; i < static_cast<int>(mImages.size()); i++)
+		for (int s = 0; s < static_cast<int>(this->temporalScales.size()); s++)
 		{
-			int j = i + t; //image to process with i
-			if (j < (int)mImages.size())
+			int pos = opticalFlowIndex(i, s);
+			if (pos >= 0)
 			{
-				FillPoints(points[0], mImages[j], mImages[i]);
+				int j = i + this->temporalScales[s]; //image to process with i
+				FillPoints(sampler, points[0], mImages[j], mImages[i]);
 
-				ParMat angles_magni;
+				ParMat &angles_magni = this->data[pos];
 				angles_magni.first = cv::Mat(rows, cols, CV_16SC1, -1); //angles
 				angles_magni.second = cv::Mat(rows, cols, CV_16SC1, -1); //magnitude
 
 				if (points[0].size() > 0)
 				{
-					calcOpticalFlowPyrLK(mImages[i], mImages[j], points[0], points[1], status, err, winSize, 3, termcrit, 0, 0.001);
+					calcOpticalFlowPyrLK(pyramid(i), pyramid(j), points[0], points[1], status, err, winSize, maxLevel, termcrit, 0, 0.001);
 					VecDesp2Mat(points[1], points[0], angles_magni);
 				}
-
-				this->data.push_back(angles_magni);
-				this->mapToOpticalFlows[i][j] = static_cast<int>(this->data.size()) - 1;
-				this->mapToOpticalFlows[j][i] = static_cast<int>(this->data.size()) - 1;
+				finishOpticalFlow(pos);
 			}
-			else
-				break;
 		}
 	}
 }
 
+void OFCM::finishOpticalFlow(int pos) {
+	// the movement filter asks for a count over each cuboid region,
+	// so an integral image of the moving pixels makes it O(1)
+	if (this->movementFilter)
+		cv::integral((this->data[pos].second >= movementThreshold) / 255, movingPixels[pos], CV_32S);
+}
+
+void OFCM::pushFrame(const cv::Mat& frame) {
+	int numScales = static_cast<int>(this->temporalScales.size());
+	cv::Size winSize(31, 31);
+	cv::TermCriteria termcrit(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 20, 0.3);
+	int maxLevel = 3;
+
+	if (!mIsPrepared)
+	{
+		setParameters();
+		int maxScale = 0;
+		for (int t : this->temporalScales)
+			maxScale = std::max(maxScale, t);
+
+		// the flows starting on a frame live in the slot of that frame, which is
+		// reused once the frame leaves the window
+		mImages.clear();
+		this->numTableFrames = this->cuboidLength + maxScale;
+		this->streamOffset = 0;
+		this->mapToOpticalFlows.assign(this->numTableFrames * numScales, -1);
+		this->data.assign(this->mapToOpticalFlows.size(), ParMat());
+		this->movingPixels.assign(this->data.size(), cv::Mat());
+		this->streamPyramids.assign(this->numTableFrames, std::vector<cv::Mat>());
+		mIsPrepared = true;
+	}
+
+	if (static_cast<int>(mImages.size()) == this->numTableFrames)
+	{
+		// the oldest frame leaves the window with the flows starting on it
+		int slot = this->streamOffset % this->numTableFrames;
+		for (int s = 0; s < numScales; s++)
+			this->mapToOpticalFlows[slot * numScales + s] = -1;
+		mImages.erase(mImages.begin());
+		this->streamOffset++;
+	}
+	mImages.push_back(frame.clone());
+	this->numImgs = static_cast<int>(mImages.size());
+
+	int j = this->streamOffset + this->numImgs - 1; //index in the stream of the new frame
+	cv::buildOpticalFlowPyramid(mImages.back(), streamPyramids[j % this->numTableFrames], winSize, maxLevel);
+
+	std::vector<cv::Point2f> points[2];
+	std::vector<uchar> status;
+	std::vector<float> err;
+	for (int s = 0; s < numScales; s++)
+	{
+		int i = j - this->temporalScales[s]; //image to process with j
+		if (i < this->streamOffset)
+			continue;
+
+		int pos = (i % this->numTableFrames) * numScales + s;
+		ParMat &angles_magni = this->data[pos];
+		angles_magni.first = cv::Mat(mImages.back().rows, mImages.back().cols, CV_16SC1, -1); //angles
+		angles_magni.second = cv::Mat(mImages.back().rows, mImages.back().cols, CV_16SC1, -1); //magnitude
+
+		FillPoints(this->movingPoints, points[0], mImages.back(), mImages[i - this->streamOffset]);
+		if (points[0].size() > 0)
+		{
+			calcOpticalFlowPyrLK(streamPyramids[i % this->numTableFrames], streamPyramids[j % this->numTableFrames], points[0], points[1], status, err, winSize, maxLevel, termcrit, 0, 0.001);
+			VecDesp2Mat(points[1], points[0], angles_magni);
+		}
+		finishOpticalFlow(pos);
+		this->mapToOpticalFlows[pos] = pos;
+	}
+}
+
 void OFCM::setParameters() {
 
 	int tamVecMagniMatrices = 4 * (this->nBinsMagnitude * this->nBinsMagnitude); // 4 co-occurrence matrices (0, 45, 90, 135)
@@ -207,45 +356,35 @@ void OFCM::setParameters() {
 
 	//this->temporalScales = splitTemporalScales(strTempScales, ',');
 
-	coocMagnitude = new CoOccurrenceGeneral(this->nBinsMagnitude, this->distanceMagnitude);
-	coocAngles = new CoOccurrenceGeneral(this->nBinsAngle, this->distanceAngle);
+	setNumWorkers(1);
 
-	this->numOpticalFlow = calcNumOptcialFlowPerCuboid();
+	this->numOpticalFlow = calcNumOptcialFlowPerCuboid(this->cuboidLength);
 
 	// It is(4 direction matrices * 12 Haralick texture features) * 2, because we have one magnitude matrix and one angle matrix, *numOpticalFlow, the number of optical flow will depend on temporal scale.
 	this->descriptorLength = ((4 * 12) + (4 * 12)) * this->numOpticalFlow;
 }
 
-inline void OFCM::FillPoints(std::vector<cv::Point2f> &vecPoints, cv::Mat frameB, cv::Mat frameA, int thr)
+inline void OFCM::FillPoints(MovingPoints &sampler, std::vector<cv::Point2f> &vecPoints, cv::Mat frameB, cv::Mat frameA)
 {
-	vecPoints.clear();
   if (frameA.channels() > 1){
     cvtColor(frameB, frameB, CV_BGR2GRAY);
     cvtColor(frameA, frameA, CV_BGR2GRAY);
   }
 
-	cv::Mat frameDif = cv::abs(frameB - frameA);
-	for (int i = 0; i < frameDif.rows; ++i)
-	{
-		for (int j = 0; j< frameDif.cols; ++j)
-		{
-			if (frameDif.at<uchar>(i, j) > thr)
-				vecPoints.push_back(cv::Point2f((float)j, (float)i));
-		}
-	}
+	cv::Mat frameDif;
+	cv::absdiff(frameB, frameA, frameDif);
+	sampler.extract(frameDif, vecPoints);
 }
 
-int OFCM::calcNumOptcialFlowPerCuboid() {
+int OFCM::calcNumOptcialFlowPerCuboid(int length) const {
 	int numOpticalFlow = 0;
-	for (size_t i = 0; i < this->cuboidLength; i++) //for (int i = 1; i < this->cuboidLength; i++)
+	for (size_t i = 0; i < length; i++) //for (int i = 1; i < this->cuboidLength; i++)
 	{
 		for (size_t j : this->temporalScales) //for (int j = 1; j <= this->temporalScale; j++)
 		{
 			size_t k = i + j; //image to process with i
-			if (k < this->cuboidLength) //if (k >= 0)
+			if (k < length) //if (k >= 0)
 				numOpticalFlow++;
-			else
-				break;
 		}
 	}
 	return numOpticalFlow;
@@ -288,14 +427,10 @@ inline void OFCM::VecDesp2Mat(std::vector<cv::Point2f> &vecPoints, std::vector<c
 	}
 }
 
-inline void OFCM::allocateMapToOpticalFlowsMatrix()
+inline int OFCM::opticalFlowIndex(int frame, int scale) const
 {
-	this->mapToOpticalFlows = new int*[this->numImgs];
-	for (int i = 0; i < this->numImgs; i++)
-	{
-		this->mapToOpticalFlows[i] = new int[this->numImgs];
-		memset(this->mapToOpticalFlows[i], 0, sizeof(int) * this->numImgs);
-	}
+	int slot = (frame + this->streamOffset) % this->numTableFrames;
+	return this->mapToOpticalFlows[slot * this->temporalScales.size() + scale];
 }
 
 std::vector<int> OFCM::splitTemporalScales(std::string str, char delimiter)
@@ -315,39 +450,24 @@ std::vector<int> OFCM::splitTemporalScales(std::string str, char delimiter)
 inline std::deque<OFCM::ParMat> OFCM::CreatePatch(const Cube& cuboid, bool & hasMovement)
 {
 	std::deque<ParMat> patches;
-	cv::Mat patchAngles, patchMagni;
+	cv::Rect region(cuboid.y0, cuboid.x0, cuboid.h, cuboid.w);
 
-	int thr = 1;
 	int t1 = cuboid.l + cuboid.t0 - 1;
 
-	for (size_t ts : this->temporalScales) //for (int ts = 1; ts <= this->temporalScale; ts++)
+	for (size_t s = 0; s < this->temporalScales.size(); s++) //for (int ts = 1; ts <= this->temporalScale; ts++)
 	{
 		for (size_t i = cuboid.t0; i < t1; i++)//for (size_t i = t0+1; i <= t1; i++) //it starts from frame 1 to compare with frame 0
 		{
-			size_t f = i + ts; //image to process with i
+			size_t f = i + this->temporalScales[s]; //image to process with i
 			if (f <= t1) //if (f >= t0)
 			{
-				int optFlowPos = this->mapToOpticalFlows[i][f];
-				ParMat angles_magni;
-
-				patchAngles = cv::Mat(this->data[optFlowPos].first, cv::Rect(cuboid.y0, cuboid.x0, cuboid.h, cuboid.w)); //on "first" we have the angles
-				patchMagni = cv::Mat(this->data[optFlowPos].second, cv::Rect(cuboid.y0, cuboid.x0, cuboid.h, cuboid.w)); //on "second" we have the magnitudes
+				int optFlowPos = opticalFlowIndex(static_cast<int>(i), static_cast<int>(s));
 
-				angles_magni.first = patchAngles.clone();
-				angles_magni.second = patchMagni.clone();
-
-				patches.push_back(angles_magni);
+				// the co-occurrence only reads the patches, so they are views on the flows in data
+				patches.push_back(ParMat(this->data[optFlowPos].first(region), this->data[optFlowPos].second(region))); //on "first" we have the angles, on "second" the magnitudes
 
 				if (!hasMovement) //if movement was not detected yet
-				{
-					for (int j = 0; j < patchMagni.rows; ++j)
-						for (int k = 0; k < patchMagni.cols; ++k)
-							if (patchMagni.at<int>(j, k) >= thr)
-							{
-						hasMovement = true;
-						k = patchMagni.cols; j = patchMagni.rows; // just to get out of this 2 loops
-							}
-				}
+					hasMovement = hasMovingPixels(optFlowPos, region);
 			}
 			else
 				break;
@@ -356,6 +476,14 @@ inline std::deque<OFCM::ParMat> OFCM::CreatePatch(const Cube& cuboid, bool & has
 
 	return patches;
 }
+
+inline bool OFCM::hasMovingPixels(int optFlowPos, const cv::Rect& region) const
+{
+	const cv::Mat_<int> sum = this->movingPixels[optFlowPos];
+	int count = sum(region.y + region.height, region.x + region.width) - sum(region.y, region.x + region.width)
+		- sum(region.y + region.height, region.x) + sum(region.y, region.x);
+	return count > 0;
+}
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 // namespace ssig
@@ -42,12 +42,17 @@
 #ifndef _SSIG_DESCRIPTORS_OFCM_FEATURES_HPP_
 #define _SSIG_DESCRIPTORS_OFCM_FEATURES_HPP_
 
+#include <algorithm>
+#include <atomic>
 #include <deque>
+#include <exception>
+#include <thread>
 #include <opencv2\video\tracking.hpp>
 
 #include "descriptor_temporal.hpp"
 #include "haralick.hpp"
 #include "co_occurrence_general.hpp"
+#include "moving_points.hpp"
 
 
 
@@ -63,9 +68,23 @@ class OFCM : public DescriptorTemporal {
 	OFCM(const OFCM& rhs);
 	OFCM& operator=(const OFCM& rhs);
 
+	//Streaming mode: instead of setData(), frames are added one at a time and only
+	//the last cuboidLength + max(temporalScales) frames are kept, with their optical
+	//flows. Cuboids given to extract() are relative to the kept frames
+	void pushFrame(const cv::Mat& frame);
+
+	//Density of the points tracked by the optical flows: one pixel of every
+	//stride x stride block and at most cellCap points per cellSize x cellSize cell
+	//(0 no cap). All the moving pixels by default
+	void setPointSampling(int stride, int cellSize, int cellCap);
+
+	int getDescriptorLength(const Cube& cuboid) const override;
+
 protected:
 	void beforeProcess() override;
 	void extractFeatures(const Cube& cuboid, cv::Mat& output) override;
+	void setNumWorkers(int numWorkers) override;
+	void extractFeatures(const Cube& cuboid, cv::Mat& output, int worker) override;
 
 private:
 	bool movementFilter = true;
@@ -77,30 +96,40 @@ private:
 	int distanceAngle;
 	int descriptorLength;
 	int cuboidLength;
-	int **mapToOpticalFlows;
+	std::vector<int> mapToOpticalFlows; //(frame, temporal scale index) -> position in data, -1 if out of the sequence
+	int numTableFrames = 0; //frames in mapToOpticalFlows, in streaming mode it is a ring over them
+	int streamOffset = 0; //index in the stream of the first kept frame
+	std::vector<std::vector<cv::Mat>> streamPyramids; //pyramid of each kept frame in streaming mode
 	int numOpticalFlow = 0; //number of computed optical flows
 	int logQuantization = 0;
 
 	float maxAngle;
 	float maxMagnitude;
 
-	CoOccurrenceGeneral *coocMagnitude;
-	CoOccurrenceGeneral *coocAngles;
+	std::vector<CoOccurrenceGeneral*> coocMagnitude; //one per worker: they keep the last matrices
+	std::vector<CoOccurrenceGeneral*> coocAngles;
 	
 	std::vector<ParMat> data;
+	std::vector<cv::Mat> movingPixels; //integral count of the moving pixels of each optical flow in data
+	static const int movementThreshold = 1; //minimum magnitude of a moving pixel
 	std::vector<int> temporalScales;
+	MovingPoints movingPoints; //moving pixels of a pair, the sampling of the workers
 
 	std::string strTempScales;
 
 	void setParameters();
 	void setOpticalFlowData();
-	int calcNumOptcialFlowPerCuboid();
+	int setOpticalFlowTable();
+	void computeOpticalFlows(int firstFrame, int lastFrame);
+	void finishOpticalFlow(int pos);
+	int calcNumOptcialFlowPerCuboid(int length) const;
 	std::vector<int> splitTemporalScales(std::string str, char delimiter);
 
 	inline std::deque<ParMat> CreatePatch(const Cube& cuboid, bool & hasMovement);
-	inline void FillPoints(std::vector<cv::Point2f> &vecPoints, cv::Mat frameB, cv::Mat frameA, int thr = 30);
+	inline void FillPoints(MovingPoints &sampler, std::vector<cv::Point2f> &vecPoints, cv::Mat frameB, cv::Mat frameA);
 	inline void VecDesp2Mat(std::vector<cv::Point2f> &vecPoints, std::vector<cv::Point2f> &positions, OFCM::ParMat & AMmat);
-	inline void allocateMapToOpticalFlowsMatrix();
+	inline int opticalFlowIndex(int frame, int scale) const;
+	inline bool hasMovingPixels(int optFlowPos, const cv::Rect& region) const;
 
 };
 
@@ -3,7 +3,9 @@
 
 #include <vector>
 #include <thread>
+#include <atomic>
 #include <mutex>
+#include <exception>
 #include <algorithm>
 #include <math.h>
 #include "opencv2/highgui/highgui.hpp"
@@ -11,7 +13,12 @@
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/video/video.hpp"
 #include "Figtree.h"
+#include "OFCM\moving_points.hpp"
 #include <fstream>
+#include <map>
+#include <cstdio>
+#include <chrono>
+#include <sstream>
 
 
 #define M_PI           3.14159265358979323846
@@ -26,36 +33,98 @@ typedef std::vector<OFparMat>							OFvecParMat;
 //heritance for Optical flow 
 struct OpticalFlowBase
 {
+	cv::Mat			_roi;	//CV_8U pixels to track (MotionGate), empty the whole frame;
+							//only the sparse OpticalFlowOCV uses it
+	OFdataType		_diffs;	//gray differences of the pairs of the next compute (FramePrep),
+							//consumed by it; when empty OpticalFlowOCV makes them
 	virtual void	compute(OFdataType &, OFvecParMat &) = 0;
 };
 
+//===========================================
+//gray of a frame, the frame itself when it is already gray
+static inline void supp_gray(const cv::Mat & img, cv::Mat & gray)
+{
+	if (img.channels() == 1)	gray = img;
+	else						cv::cvtColor(img, gray, CV_BGR2GRAY);
+}
+//|gray(i+1) - gray(i)| of the consecutive pairs of a sequence, each frame is
+//converted once
+static inline void supp_frame_diffs(const OFdataType & frames, OFdataType & diffs)
+{
+	diffs.clear();
+	cv::Mat		prev, next;
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		supp_gray(frames[i], next);
+		if (i > 0)
+		{
+			diffs.push_back(cv::Mat());
+			cv::absdiff(next, prev, diffs.back());
+		}
+		prev = next;
+	}
+}
+
+//===========================================
+//pre-processing of the frames shared by every mode: the frame at
+//main_image_scale with the interpolation of main_image_interpolation, its gray
+//and the difference with the gray of the previous frame of the sequence, each
+//made once per frame
+struct FramePrep
+{
+	double	_scale			= 0;				//<= 0 keeps the size
+	int		_interpolation	= cv::INTER_CUBIC;
+	cv::Mat	_prevGray;							//gray of the last frame of the sequence
+
+	//nearest, linear, cubic, area or lanczos; area and linear are much
+	//cheaper than cubic to reduce the frames
+	static int interpolation(const std::string & name)
+	{
+		if (name == "nearest")	return cv::INTER_NEAREST;
+		if (name == "linear")	return cv::INTER_LINEAR;
+		if (name == "area")		return cv::INTER_AREA;
+		if (name == "lanczos")	return cv::INTER_LANCZOS4;
+		return cv::INTER_CUBIC;
+	}
+	//the frame at the scale, in place
+	void scale(cv::Mat & img) const
+	{
+		if (_scale > 0)
+			cv::resize(img, img, cv::Size(), _scale, _scale, _interpolation);
+	}
+	//the frame at the scale, its gray and the difference with the previous
+	//gray, empty for the first frame of the sequence
+	void next(cv::Mat & img, cv::Mat & gray, cv::Mat & diff)
+	{
+		scale(img);
+		supp_gray(img, gray);
+		if (_prevGray.empty() || _prevGray.size() != gray.size())
+			diff.release();
+		else
+			cv::absdiff(gray, _prevGray, diff);
+		//a gray frame is its own gray and the caller may decode over it
+		_prevGray = gray.data == img.data ? gray.clone() : gray;
+	}
+	//a new sequence starts
+	void reset()
+	{
+		_prevGray.release();
+	}
+};
+
 //===========================================
 //heritance for OF 
 
 
 struct OpticalFlowOCV : public OpticalFlowBase
 {
+	MovingPoints	_points;	//pixels of each pair to track and their density
+
+	OpticalFlowOCV(const MovingPoints & points = MovingPoints()) : _points(points){}
 	virtual void	compute(OFdataType & /*in*/, OFvecParMat & /*out*/);
 };
 
 
-static inline void FillPointsOriginal(std::vector<cv::Point2f> &vecPoints, cv::Mat  fr_A, cv::Mat  fr_a, int thr = 30)
-{
-	vecPoints.clear();
-	cv::cvtColor(fr_A, fr_A, CV_BGR2GRAY);
-	cv::cvtColor(fr_a, fr_a, CV_BGR2GRAY);
-	//frame substraction
-	cv::Mat fg = fr_A - fr_a;
-	for (int i = 0; i < fg.rows; ++i)
-	{
-		for (int j = 0; j< fg.cols; ++j)
-		{
-			if (abs(fg.at<uchar>(i, j))  >thr)
-				vecPoints.push_back(cv::Point2f((float)j, (float)i));
-		}
-	}
-}
-
 static inline void VecDesp2Mat(std::vector<cv::Point2f> &vecPoints, std::vector<cv::Point2f> &positions, std::pair<cv::Mat_<float>, cv::Mat_<float> > & AMmat)
 {
 	float	magnitude,
@@ -87,13 +156,26 @@ void OpticalFlowOCV::compute(OFdataType & in, OFvecParMat & out)
 	cv::Size				winSize(31, 31);
 	cv::TermCriteria		termcrit(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 20, 0.3);
 	int						rows,
-							cols;
+							cols,
+							maxLevel = 3;
+	//each frame is the next image of a pair and the previous of the
+	//following one, so its pyramid is built once and kept for two pairs
+	std::vector<cv::Mat>	pyramids[2];
+	//the differences of the pre-processing when it gave them
+	OFdataType				diffs;
+	diffs.swap(_diffs);
+	if (diffs.size() != in.size() - 1)
+		supp_frame_diffs(in, diffs);
 	//.......................................................
 	rows = in[0].rows;
 	cols = in[0].cols;
+	cv::buildOpticalFlowPyramid(in[0], pyramids[0], winSize, maxLevel);
 	for (size_t i = 0; i < in.size() - 1; ++i){
 		//std::cout << "image" << i<<std::endl;
-		FillPointsOriginal(pointsprev, in[i + 1], in[i]);
+		std::vector<cv::Mat>	&prevPyr = pyramids[i % 2],
+								&nextPyr = pyramids[(i + 1) % 2];
+		cv::buildOpticalFlowPyramid(in[i + 1], nextPyr, winSize, maxLevel);
+		_points.extract(diffs[i], pointsprev, _roi);
 		cv::Mat angles(rows, cols, CV_32FC1, cvScalar(0.));
 		cv::Mat magni(rows, cols, CV_32FC1, cvScalar(0.));
 		OFparMat data;
@@ -101,8 +183,8 @@ void OpticalFlowOCV::compute(OFdataType & in, OFvecParMat & out)
 		data.second = magni;
 		//computing optical flow por each pixel
 		if (pointsprev.size()>0){
-			cv::calcOpticalFlowPyrLK(in[i], in[i + 1], pointsprev, pointsnext,
-				status, err, winSize, 3, termcrit, 0, 0.001);
+			cv::calcOpticalFlowPyrLK(prevPyr, nextPyr, pointsprev, pointsnext,
+				status, err, winSize, maxLevel, termcrit, 0, 0.001);
 			VecDesp2Mat(pointsnext, pointsprev, data);
 		}
 
@@ -234,111 +316,829 @@ static cv::Mat supp_vecMax(std::vector<cv::Mat> & vec)
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 typedef		std::vector<cv::Mat>	gabor_res;
-std::mutex	mtx;
-
-//normalize array or matriz A using percentil
-cv::Mat_<float> supp_norm_percentil(cv::Mat img, int base, int top){
-	//cv::Mat rsh = img.reshape(0, 1);
-	cv::Mat_<float> A = img;
-	std::vector<double> vec_ord;
-	for (int i = 0; i < img.rows; i++)
-	{
-		std::vector<double> row;
-		img.row(i).copyTo(row);
-		vec_ord.insert(vec_ord.end(), row.begin(), row.end() );
-	}
-	std::sort(vec_ord.begin(), vec_ord.end());
-	int	pos_base = std::floor(vec_ord.size() * base / 100),
-		pos_top	 = std::floor(vec_ord.size() * top  / 100);
-	double	val_base = vec_ord[pos_base],
-			val_top	 = vec_ord[pos_top];
-	A = A - val_base;
-	A = A / val_top;
-	for (int i = 0; i < A.rows; ++i){
-		for (int j = 0; j < A.cols; ++j){
-			if (A(i, j) < 0)
-				A(i, j) = 0;
-			else
-			{
-				if (A(i, j) > 1)
-					A(i, j) = 1;
+
+//normalize array or matriz A using percentil: (A - p_base) / p_top clamped to
+//[0, 1]. The percentiles come from nth_element over a scratch copy that is kept
+//between calls, or from a fixed-bin histogram when an approximation is enough
+struct PercentileNormalizer
+{
+	PercentileNormalizer(bool approximate = false, int bins = 4096) :
+		approximate(approximate), bins(bins) {}
+
+	cv::Mat_<float>	operator()(const cv::Mat & img, int base, int top);
+	void			percentiles(const cv::Mat_<float> & A, int base, int top, double & val_base, double & val_top);
+
+private:
+	bool				approximate;
+	int					bins;
+	std::vector<float>	scratch;
+	std::vector<int>	histogram;
+
+	double	histogramValue(size_t pos, float lo, float width) const;
+};
+
+void PercentileNormalizer::percentiles(const cv::Mat_<float> & A, int base, int top, double & val_base, double & val_top)
+{
+	size_t	n = A.total();
+	size_t	pos_base = std::min(n * base / 100, n - 1),
+			pos_top  = std::min(n * top  / 100, n - 1);
+
+	if (approximate)
+	{
+		double lo, hi;
+		cv::minMaxLoc(A, &lo, &hi);
+		float width = (float)(hi - lo) / bins;
+		histogram.assign(bins, 0);
+		for (int i = 0; i < A.rows; ++i)
+		{
+			const float *a = A[i];
+			for (int j = 0; j < A.cols; ++j)
+				histogram[width > 0 ? std::min((int)((a[j] - lo) / width), bins - 1) : 0]++;
+		}
+		val_base = histogramValue(pos_base, (float)lo, width);
+		val_top  = histogramValue(pos_top,  (float)lo, width);
+		return;
+	}
+
+	scratch.resize(n);
+	for (int i = 0; i < A.rows; ++i)
+		std::copy(A[i], A[i] + A.cols, scratch.begin() + (size_t)i * A.cols);
+	//the second selection only looks at the side of the first one where it lies
+	std::nth_element(scratch.begin(), scratch.begin() + pos_top, scratch.end());
+	val_top = scratch[pos_top];
+	if (pos_base < pos_top)
+		std::nth_element(scratch.begin(), scratch.begin() + pos_base, scratch.begin() + pos_top);
+	else if (pos_base > pos_top)
+		std::nth_element(scratch.begin() + pos_top + 1, scratch.begin() + pos_base, scratch.end());
+	val_base = scratch[pos_base];
+}
+
+//value of the sorted position pos, interpolated inside its bin
+double PercentileNormalizer::histogramValue(size_t pos, float lo, float width) const
+{
+	size_t cum = 0;
+	for (int b = 0; b < bins; ++b)
+	{
+		if (cum + histogram[b] > pos)
+			return lo + width * (b + (double)(pos - cum) / histogram[b]);
+		cum += histogram[b];
+	}
+	return lo + width * bins;
+}
+
+cv::Mat_<float> PercentileNormalizer::operator()(const cv::Mat & img, int base, int top)
+{
+	cv::Mat_<float>	A = img, out;
+	double			val_base, val_top;
+	if (A.empty())
+		return out;
+	percentiles(A, base, top, val_base, val_top);
+	//scale and clamp with vectorized whole matrix operations
+	A.convertTo(out, CV_32F, 1.0 / val_top, -val_base / val_top);
+	cv::min(out, 1.0, out);
+	cv::max(out, 0.0, out);
+	return out;
+}
+
+//each thread keeps its own scratch buffer between calls
+cv::Mat_<float> supp_norm_percentil(cv::Mat img, int base, int top, bool approximate = false){
+	thread_local PercentileNormalizer	exact(false),
+										approx(true);
+	return approximate ? approx(img, base, top) : exact(img, base, top);
+}
+
+//runs f(i) for every i in [0, n), the indices are taken by numThreads workers
+//(0: one per core) as they finish the previous one. An exception stops handing
+//out indices and the first one is rethrown in the caller once all have joined
+template <class F>
+void supp_parallel_for(int n, F f, int numThreads = 0)
+{
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	numThreads = std::max(1, std::min(numThreads, n));
+	std::atomic<int> next(0);
+	std::vector<std::exception_ptr> errors(numThreads);
+	auto worker = [&](int w){
+		try{
+			for (int i = next++; i < n; i = next++)
+				f(i);
+		}
+		catch (...){
+			errors[w] = std::current_exception();
+			next = n;
+		}
+	};
+	std::vector<std::thread> t;
+	for (int w = 1; w < numThreads; ++w)
+		t.push_back(std::thread(worker, w));
+	if (n > 0)
+		worker(0);
+	for (auto & th : t)
+		th.join();
+	for (auto & e : errors)
+		if (e)
+			std::rethrow_exception(e);
+}
+
+//thread safe progress of a job of total units: the count, the elapsed time and
+//the estimated time left, printed at most once every interval seconds and when
+//the job ends
+struct ProgressReport
+{
+	ProgressReport(const std::string & label, long long total, double interval = 1.0) :
+		_label(label), _total(total), _done(0), _interval(interval),
+		_start(std::chrono::steady_clock::now()), _last(_start){}
+
+	void step(long long n = 1)
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		_done += n;
+		auto now = std::chrono::steady_clock::now();
+		if (_done >= _total ||
+			std::chrono::duration<double>(now - _last).count() >= _interval)
+		{
+			_last = now;
+			print(now);
+		}
+	}
+	//a whole line, not mixed with the ones of other threads
+	void note(const std::string & msg)
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		std::cout << msg << std::endl;
+	}
+
+private:
+	std::mutex								_mtx;
+	std::string								_label;
+	long long								_total,
+											_done;
+	double									_interval;
+	std::chrono::steady_clock::time_point	_start,
+											_last;
+
+	void print(std::chrono::steady_clock::time_point now)
+	{
+		double				elapsed = std::chrono::duration<double>(now - _start).count();
+		std::stringstream	line;
+		line << _label << " " << _done << "/" << _total;
+		if (_total > 0)
+			line << " (" << (int)(100.0 * _done / _total) << "%)";
+		line << " elapsed " << (int)elapsed << "s";
+		if (_done > 0 && _done < _total)
+			line << " eta " << (int)(elapsed * (_total - _done) / _done) << "s";
+		std::cout << line.str() << std::endl;
+	}
+};
+
+//Gabor bank: the kernels of every (scale, orientation) are built once and kept
+//while the frame size does not change. Large kernels are applied in the frequency
+//domain: the spectrum of a frame is computed once and shared by the whole bank,
+//and the real and imaginary parts come from a single complex product
+struct GaborBank
+{
+	//approximateNorm takes the normalization percentiles from a histogram
+	GaborBank(short scales, short orientation, cv::Size kernel, bool uniontype = true,
+			  bool approximateNorm = false);
+	//one normalized response per scale
+	void	compute(const cv::Mat & gray, gabor_res & out);
+	//the same for a sequence of frames of the same size, the (frame, scale) pairs
+	//are shared by numThreads workers
+	void	compute(const std::vector<cv::Mat> & grays, std::vector<gabor_res> & out, int numThreads = 0);
+
+private:
+	short					scales,
+							orientation;
+	bool					uniontype,
+							approximateNorm;
+	std::vector<cv::Mat>	kernelsRe,		//kernel of scale u and orientation v at u * orientation + v
+							kernelsIm,
+							kernelsDft;		//their spectra for dftSize
+	cv::Size				frameSize,
+							dftSize;
+
+	bool	useDft() const { return kernelsRe[0].rows * kernelsRe[0].cols >= 11 * 11; }
+	void	prepare(cv::Size size);
+	void	spectrum(const cv::Mat & gray, cv::Mat & out) const;
+	cv::Mat	response(const cv::Mat & gray, const cv::Mat & spec, int u) const;
+};
+
+GaborBank::GaborBank(short scales, short orientation, cv::Size kernel, bool uniontype,
+					 bool approximateNorm) :
+	scales(scales), orientation(orientation), uniontype(uniontype), approximateNorm(approximateNorm)
+{
+	float f = 1.414213562;
+	for (int u = 0; u < scales; ++u) {
+		float k = M_PI / pow(f, u);
+		for (int v = 0; v < orientation; ++v) {
+			float phi = v * M_PI / orientation;
+			cv::Mat rk(kernel.width * 2 + 1, kernel.height * 2 + 1, CV_32F); // real		part
+			cv::Mat ik(kernel.width * 2 + 1, kernel.height * 2 + 1, CV_32F); // imaginary	part
+			for (int x = -kernel.width; x <= kernel.width; ++x) {
+				for (int y = -kernel.height; y <= kernel.height; ++y) {
+					float _x = x * cos(phi) + y * sin(phi);
+					float _y = -x * sin(phi) + y * cos(phi);
+					float c = exp(-(_x * _x + _y * _y) / (4 * M_PI * M_PI));
+					rk.at<float>(x + kernel.width, y + kernel.height) = c * cos(k * _x);
+					ik.at<float>(x + kernel.width, y + kernel.height) = c * sin(k * _x);
+				}
 			}
+			kernelsRe.push_back(rk);
+			kernelsIm.push_back(ik);
 		}
-	}/**/
-	return A;
+	}
 }
 
-//gabor x scale 
-void gaborxscale(gabor_res &features, cv::Mat & gray, short scales, short orientation, cv::Size kernel, int u,bool uniontype = true)
+//the kernel spectra depend on the frame size, they are rebuilt only when it changes
+void GaborBank::prepare(cv::Size size)
+{
+	if (size == frameSize)
+		return;
+	frameSize = size;
+	if (!useDft())
+		return;
+
+	//the frame is padded by the kernel radius, so the circular product has no wrap
+	//around on the pixels that are kept
+	int kr = kernelsRe[0].rows, kc = kernelsRe[0].cols;
+	dftSize = cv::Size(cv::getOptimalDFTSize(size.width + kc - 1),
+					   cv::getOptimalDFTSize(size.height + kr - 1));
+	kernelsDft.resize(kernelsRe.size());
+	for (size_t i = 0; i < kernelsRe.size(); ++i) {
+		//filter2D correlates, so the kernel is flipped to get the same result
+		cv::Mat parts[2], complexKernel, padded = cv::Mat::zeros(dftSize, CV_32FC2);
+		cv::flip(kernelsRe[i], parts[0], -1);
+		cv::flip(kernelsIm[i], parts[1], -1);
+		cv::merge(parts, 2, complexKernel);
+		complexKernel.copyTo(padded(cv::Rect(0, 0, kc, kr)));
+		cv::dft(padded, kernelsDft[i], cv::DFT_COMPLEX_OUTPUT);
+	}
+}
+
+void GaborBank::spectrum(const cv::Mat & gray, cv::Mat & out) const
+{
+	int kr = kernelsRe[0].rows, kc = kernelsRe[0].cols;
+	cv::Mat bordered, padded = cv::Mat::zeros(dftSize, CV_32F);
+	//same border as filter2D
+	cv::copyMakeBorder(gray, bordered, kr / 2, kr / 2, kc / 2, kc / 2, cv::BORDER_REFLECT_101);
+	bordered.convertTo(padded(cv::Rect(0, 0, bordered.cols, bordered.rows)), CV_32F);
+	cv::dft(padded, out, cv::DFT_COMPLEX_OUTPUT);
+}
+
+cv::Mat GaborBank::response(const cv::Mat & gray, const cv::Mat & spec, int u) const
 {
-	/*float f = 1.414213562;
-	float k = M_PI/ pow(f, u);
 	std::vector<cv::Mat> scalevec(orientation);
-	// test for 8 orientations
 	for (int v = 0; v < orientation; ++v) {
+		int		id = u * orientation + v;
+		cv::Mat	i, r;
+		if (useDft()) {
+			cv::Mat product, parts[2];
+			cv::mulSpectrums(spec, kernelsDft[id], product, 0);
+			cv::dft(product, product, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_COMPLEX_OUTPUT);
+			cv::split(product(cv::Rect(kernelsRe[0].cols - 1, kernelsRe[0].rows - 1, gray.cols, gray.rows)), parts);
+			r = parts[0];
+			i = parts[1];
+		}
+		else {
+			cv::filter2D(gray, r, CV_32F, kernelsRe[id]);
+			cv::filter2D(gray, i, CV_32F, kernelsIm[id]);
+		}
+		// calc mag
+		cv::magnitude(r, i, scalevec[v]);
+	}
+	//max or sum over the orientations
+	cv::Mat mt = uniontype ? supp_vecMax(scalevec) : supp_vecSum(scalevec);
+	//================normalysing==============================================
+	return supp_norm_percentil(mt, 10, 99, approximateNorm);
+}
+
+void GaborBank::compute(const cv::Mat & gray, gabor_res & out)
+{
+	cv::Mat spec;
+	prepare(gray.size());
+	if (useDft())
+		spectrum(gray, spec);
+	out.resize(scales);
+	for (int u = 0; u < scales; ++u)
+		out[u] = response(gray, spec, u);
+}
 
-		float phi = v * M_PI / orientation;
+void GaborBank::compute(const std::vector<cv::Mat> & grays, std::vector<gabor_res> & out, int numThreads)
+{
+	out.assign(grays.size(), gabor_res(scales));
+	if (grays.empty())
+		return;
+	prepare(grays[0].size());
+	std::vector<cv::Mat> specs(grays.size());
+	if (useDft())
+		supp_parallel_for((int)grays.size(), [&](int i){
+			assert(grays[i].size() == frameSize);
+			spectrum(grays[i], specs[i]);
+		}, numThreads);
+	supp_parallel_for((int)grays.size() * scales, [&](int t){
+		out[t / scales][t % scales] = response(grays[t / scales], specs[t / scales], t % scales);
+	}, numThreads);
+}
 
-		// build kernel
-		cv::Mat rk(kernel.width * 2 + 1, kernel.height * 2 + 1, CV_32F); // real		part
-		cv::Mat ik(kernel.width * 2 + 1, kernel.height * 2 + 1, CV_32F); // imaginary	part
-		for (int x = -kernel.width; x <= kernel.width; ++x) {
-			for (int y = -kernel.height; y <= kernel.height; ++y) {
+//index of the scale with the highest response of each pixel, the first one on
+//ties. It is computed once per frame, so the descriptors only read a byte
+void supp_gabor_argmax(const gabor_res & scales, cv::Mat_<uchar> & argmax)
+{
+	assert(scales.size() && scales.size() < 256);
+	cv::Mat maxval = scales[0].clone();
+	argmax.create(scales[0].rows, scales[0].cols);
+	argmax = 0;
+	for (size_t k = 1; k < scales.size(); ++k)
+	{
+		argmax.setTo((int)k, scales[k] > maxval);
+		cv::max(maxval, scales[k], maxval);
+	}
+}
 
-				float _x = x * cos(phi) + y * sin(phi);
-				float _y = -x * sin(phi) + y * cos(phi);
-				float c = exp(-(_x * _x + _y * _y) / (4 * M_PI * M_PI));
-				rk.at<float>(x + kernel.width, y + kernel.height) = c * cos(k * _x);
-				ik.at<float>(x + kernel.width, y + kernel.height) = c * sin(k * _x);
-			} 
+//single frame, the scales are computed in parallel
+gabor_res supp_gabor_filter(cv::Mat & image, short scales, short orientation, cv::Size kernel, bool uniontype = true)
+{
+	std::vector<gabor_res>	features;
+	GaborBank				bank(scales, orientation, kernel, uniontype);
+	bank.compute(std::vector<cv::Mat>(1, image), features);
+	return features[0];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//binary store for flows and features: the number of matrices and then, for each
+//one, its rows, cols and type followed by the raw data
+void supp_vectorMat2BIN(const std::vector<cv::Mat> & vec, const std::string & dest)
+{
+	std::ofstream	out(dest, std::ios::binary);
+	int				n = (int)vec.size();
+	out.write((const char *)&n, sizeof(int));
+	for (auto & item : vec)
+	{
+		cv::Mat	mt = item.isContinuous() ? item : item.clone();
+		int		header[3] = { mt.rows, mt.cols, mt.type() };
+		out.write((const char *)header, sizeof(header));
+		out.write((const char *)mt.data, mt.total() * mt.elemSize());
+	}
+}
+
+//false when the file is missing or truncated, or a header is not valid (negative
+//sizes, an unknown type or more data than is left in the file); vec is left
+//empty then
+bool supp_BIN2vectorMat(const std::string & src, std::vector<cv::Mat> & vec)
+{
+	std::ifstream	in(src, std::ios::binary | std::ios::ate);
+	int				n = 0;
+	vec.clear();
+	if (!in)
+		return false;
+	double			left = (double)in.tellg() - sizeof(int);
+	in.seekg(0);
+	if (!in.read((char *)&n, sizeof(int)) || n < 0 || n * 3.0 * sizeof(int) > left)
+		return false;
+	vec.resize(n);
+	for (auto & item : vec)
+	{
+		int header[3];
+		if (!in.read((char *)header, sizeof(header)))
+		{
+			vec.clear();
+			return false;
+		}
+		left -= sizeof(header);
+		if (header[0] < 0 || header[1] < 0 || header[2] < 0 ||
+			CV_MAT_DEPTH(header[2]) > CV_64F || header[2] > CV_MAKETYPE(CV_64F, CV_CN_MAX))
+		{
+			vec.clear();
+			return false;
+		}
+		double	bytes = (double)header[0] * header[1] * CV_ELEM_SIZE(header[2]);
+		if (bytes > left)
+		{
+			vec.clear();
+			return false;
+		}
+		item.create(header[0], header[1], header[2]);
+		if (!in.read((char *)item.data, item.total() * item.elemSize()))
+		{
+			vec.clear();
+			return false;
 		}
+		left -= bytes;
+	}
+	return true;
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//Descriptor output of a whole sequence: windows x cuboids x bins floats in a
+//single buffer. CUBOID_MAJOR keeps the windows of a cuboid together (what the
+//matchers read), WINDOW_MAJOR keeps a window together (cheap to append). The
+//views returned by cuboid() and window() share the buffer and are invalidated
+//by the next beginWindow()...................................................
+struct HistogramSink
+{
+	enum Layout { CUBOID_MAJOR = 0, WINDOW_MAJOR = 1 };
 
-		// convolve with image
-		cv::Mat i, r;
-		cv::filter2D(gray, r, CV_32F, rk);
-		cv::filter2D(gray, i, CV_32F, ik);
+	HistogramSink(Layout layout = CUBOID_MAJOR) :
+		_layout(layout), _windows(0), _capacity(0), _cuboids(0), _bins(0){}
 
-		// calc mag
-		cv::Mat mag;
-		cv::pow(i, 2, i);
-		cv::pow(r, 2, r);
-		cv::pow(i + r, 0.5, mag);
+	int		windows() const { return _windows; }
+	int		cuboids() const { return _cuboids; }
+	int		bins() const	{ return _bins; }
+	Layout	layout() const	{ return _layout; }
 
-		// downsampling
-		//cv::resize(mag, mag, cv::Size(), downscale, downscale, CV_INTER_NN);
+	void clear()
+	{
+		_data.clear();
+		_windows = _capacity = _cuboids = _bins = 0;
+	}
+	//__________________________________________________________________________
+	//room for n windows, so a known sequence length is allocated once
+	void reserve(int n)
+	{
+		if (n <= _capacity)
+			return;
+		if (_layout == CUBOID_MAJOR && _windows)
+		{
+			//each cuboid block grows, so the windows are moved to their new place
+			std::vector<float>	data((size_t)_cuboids * n * _bins, 0.f);
+			for (int c = 0; c < _cuboids; ++c)
+				std::copy_n(&_data[(size_t)c * _capacity * _bins], (size_t)_windows * _bins,
+							&data[(size_t)c * n * _bins]);
+			_data.swap(data);
+		}
+		else
+			_data.resize((size_t)_cuboids * n * _bins, 0.f);
+		_capacity = n;
+	}
+	//__________________________________________________________________________
+	//opens the next window with all its histograms set to 0 and returns its
+	//index; the first window fixes the number of cuboids and bins
+	int beginWindow(int cuboids, int bins)
+	{
+		if (!_windows)
+		{
+			_cuboids	= cuboids;
+			_bins		= bins;
+			_data.assign((size_t)_cuboids * _capacity * _bins, 0.f);
+		}
+		CV_Assert(cuboids == _cuboids && bins == _bins);
+		if (_windows == _capacity)
+			reserve(std::max(2 * _capacity, 16));
+		for (int c = 0; c < _cuboids; ++c)
+			std::fill_n(histogram(_windows, c), _bins, 0.f);
+		return _windows++;
+	}
+	//__________________________________________________________________________
+	float * histogram(int window, int cuboid)
+	{
+		return &_data[offset(window, cuboid)];
+	}
+	const float * histogram(int window, int cuboid) const
+	{
+		return &_data[offset(window, cuboid)];
+	}
+	//__________________________________________________________________________
+	//windows x bins, one row per window
+	cv::Mat_<float> cuboid(int c)
+	{
+		size_t step = (_layout == CUBOID_MAJOR ? 1 : _cuboids) * _bins * sizeof(float);
+		return _windows ? cv::Mat_<float>(_windows, _bins, histogram(0, c), step)
+						: cv::Mat_<float>();
+	}
+	//cuboids x bins, one row per cuboid
+	cv::Mat_<float> window(int w)
+	{
+		size_t step = (_layout == CUBOID_MAJOR ? _capacity : 1) * _bins * sizeof(float);
+		return cv::Mat_<float>(_cuboids, _bins, histogram(w, 0), step);
+	}
+	//__________________________________________________________________________
+	//takes the rows of a cuboid major matrix, `windows` rows per cuboid
+	void assign(const cv::Mat & rows, int windows)
+	{
+		clear();
+		_layout = CUBOID_MAJOR;
+		if (rows.empty() || windows <= 0)
+			return;
+		_cuboids	= rows.rows / windows;
+		_bins		= rows.cols;
+		reserve(windows);
+		_windows	= windows;
+		for (int r = 0; r < _cuboids * windows; ++r)
+			std::copy_n(rows.ptr<float>(r), _bins, &_data[(size_t)r * _bins]);
+	}
+
+private:
+	Layout				_layout;
+	int					_windows,
+						_capacity,
+						_cuboids,
+						_bins;
+	std::vector<float>	_data;
 
-		// store
-		scalevec[v] = mag;
+	size_t offset(int window, int cuboid) const
+	{
+		return _layout == CUBOID_MAJOR
+			? ((size_t)cuboid * _capacity + window) * _bins
+			: ((size_t)window * _cuboids + cuboid) * _bins;
 	}
-	//using the sum
-	cv::Mat mt	= uniontype? supp_vecMax(scalevec): supp_vecSum(scalevec);
-	
-	//================normalysing==============================================
-	
-	mt = supp_norm_percentil(mt, 10, 99);
+};
 
-	//------------------in case of doubs using mutex---------------------------
-	//i think it does not necessary 
-	mtx.lock();
-	features[u] = mt;
-	mtx.unlock();*/
+//------------------------------------------------------------------------------
+bool supp_isBIN(const std::string & file)
+{
+	return file.size() > 4 && file.compare(file.size() - 4, 4, ".bin") == 0;
 }
 
-gabor_res supp_gabor_filter(cv::Mat & image, short scales, short orientation, cv::Size kernel, bool uniontype = true)
-//gabor_res supp_gabor_filter(cv::Mat & image, short scales, short orientation, float downscale, cv::Size kernel, bool uniontype = true)
+//------------------------------------------------------------------------------
+//binary descriptor file: windows, cuboids, bins and then the histograms in
+//cuboid major order, whatever the layout of the sink
+void supp_sink2BIN(const HistogramSink & sink, const std::string & dest)
 {
-	
-	gabor_res	features(scales);
-	std::vector<std::thread> t(scales);
-	for (int u = 0; u < scales; ++u) 
-		t[u] =  std::thread(gaborxscale, std::ref(features), std::ref(image), scales, orientation, kernel, u, uniontype);
-	for (int u = 0; u < scales; ++u)
-		t[u].join();
-	return features;
+	std::ofstream	out(dest, std::ios::binary);
+	int				header[3] = { sink.windows(), sink.cuboids(), sink.bins() };
+	out.write((const char *)header, sizeof(header));
+	for (int c = 0; c < sink.cuboids(); ++c)
+		for (int w = 0; w < sink.windows(); ++w)
+			out.write((const char *)sink.histogram(w, c), sink.bins() * sizeof(float));
 }
 
+//false when the file is missing, its header is not valid or the histograms of
+//the header are not exactly the rest of the file
+bool supp_BIN2sink(const std::string & src, HistogramSink & sink)
+{
+	std::ifstream	in(src, std::ios::binary | std::ios::ate);
+	int				header[3];
+	sink.clear();
+	if (!in)
+		return false;
+	double			size = (double)in.tellg() - sizeof(header);
+	in.seekg(0);
+	if (!in.read((char *)header, sizeof(header)))
+		return false;
+	if (header[0] < 0 || header[1] < 0 || header[2] < 0 ||
+		(double)header[0] * header[1] * header[2] * sizeof(float) != size)
+		return false;
+	cv::Mat_<float>	rows(header[0] * header[1], header[2]);
+	if (!rows.empty() &&
+		!in.read((char *)rows.data, rows.total() * sizeof(float)))
+		return false;
+	sink.assign(rows, header[0]);
+	return true;
+}
+
+//------------------------------------------------------------------------------
+//descriptor file of the matchers, each file is read by its own extension: ".bin"
+//at once into a sink, the others (yml) cuboid by cuboid. open() is false when
+//the file cannot be read
+struct DescriptorReader
+{
+	HistogramSink		_sink;
+	cv::FileStorage		_fs;
+	bool				_binary		= false;
+	int					_cuboids	= 0;
+
+	bool open(const std::string & file)
+	{
+		_binary		= supp_isBIN(file);
+		_cuboids	= 0;
+		if (_binary)
+		{
+			if (!supp_BIN2sink(file, _sink))
+				return false;
+			_cuboids = _sink.cuboids();
+			return true;
+		}
+		if (!_fs.open(file, cv::FileStorage::READ) || _fs["CuboidNumber"].empty())
+			return false;
+		_fs["CuboidNumber"] >> _cuboids;
+		return true;
+	}
+	//windows x bins of a cuboid, a view of the sink for binary files
+	cv::Mat cuboid(int c)
+	{
+		if (_binary)
+			return _sink.cuboid(c);
+		cv::Mat				out;
+		std::stringstream	key;
+		key << "cuboid" << c;
+		_fs[key.str()] >> out;
+		return out;
+	}
+};
 
+//------------------------------------------------------------------------------
+//writes the descriptors of a sequence, ".bin" files in binary and the others
+//as yml with one matrix per cuboid (the format of supp_vectorMat2YML)
+void supp_sink2File(HistogramSink & sink, const std::string & dest, const std::string & token)
+{
+	if (supp_isBIN(dest))
+	{
+		supp_sink2BIN(sink, dest);
+		return;
+	}
+	cv::FileStorage fs(dest, cv::FileStorage::WRITE);
+	fs << "CuboidNumber" << sink.cuboids();
+	for (int c = 0; c < sink.cuboids(); ++c)
+	{
+		std::stringstream strcub;
+		strcub << token << c;
+		fs << strcub.str() << cv::Mat(sink.cuboid(c));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//64 bit FNV-1a of everything added, used as the address of cached results....
+struct ContentHash
+{
+	unsigned long long	_h;
+	ContentHash() : _h(1469598103934665603ULL){}
+
+	void add(const void * data, size_t n)
+	{
+		const unsigned char * p = (const unsigned char *)data;
+		for (size_t i = 0; i < n; ++i)
+		{
+			_h ^= p[i];
+			_h *= 1099511628211ULL;
+		}
+	}
+	//the length goes first, so consecutive strings can not be mixed up
+	void add(const std::string & str)
+	{
+		add((unsigned long long)str.size());
+		add(str.data(), str.size());
+	}
+	void add(unsigned long long v)	{ add(&v, sizeof(v)); }
+	void add(double v)				{ add(&v, sizeof(v)); }
+	//value of a config node, lists and maps element by element
+	void add(const cv::FileNode & node)
+	{
+		if (node.isString())
+			add((std::string)node);
+		else if (node.isInt() || node.isReal())
+			add((double)node);
+		else if (node.isSeq() || node.isMap())
+		{
+			add((unsigned long long)node.size());
+			for (cv::FileNodeIterator it = node.begin(); it != node.end(); ++it)
+			{
+				if (node.isMap())
+					add((*it).name());
+				add(*it);
+			}
+		}
+	}
+	//whole content of a file, false if it can not be read
+	bool addFile(const std::string & path)
+	{
+		std::ifstream	in(path, std::ios::binary);
+		if (!in)
+			return false;
+		std::vector<char>	buffer(1 << 16);
+		while (in)
+		{
+			in.read(buffer.data(), buffer.size());
+			add(buffer.data(), (size_t)in.gcount());
+		}
+		return true;
+	}
+	std::string hex() const
+	{
+		char str[17];
+		sprintf(str, "%016llx", _h);
+		return str;
+	}
+};
+
+//------------------------------------------------------------------------------
+//On disk cache of descriptor outputs. Each entry is the binary sink file
+//<dir>/<key>.bin, and <dir>/index.txt keeps the size and last use of the
+//entries across runs. When the total size or the number of entries goes over
+//its limit (0: no limit) the least recently used entries are removed. The
+//directory must exist; an empty one leaves the cache off. Lookups and stores
+//of all the caches of the process are serialized and each one re-reads the
+//index first, so several instances can share a directory (processes cannot)...
+struct DescriptorCache
+{
+	DescriptorCache() : _maxBytes(0), _maxEntries(0), _clock(0), _total(0){}
+
+	bool enabled() const { return !_dir.empty(); }
+
+	void open(const std::string & dir, double maxMB, int maxEntries)
+	{
+		_dir		= dir;
+		_maxBytes	= (long long)(maxMB * 1024 * 1024);
+		_maxEntries = maxEntries;
+		_clock		= _total = 0;
+		_entries.clear();
+		if (!enabled())
+			return;
+		std::lock_guard<std::mutex> lock(mutex());
+		read();
+	}
+	//__________________________________________________________________________
+	bool load(const std::string & key, HistogramSink & sink)
+	{
+		if (!enabled())
+			return false;
+		std::lock_guard<std::mutex> lock(mutex());
+		read();
+		auto it = _entries.find(key);
+		if (it == _entries.end())
+			return false;
+		if (!supp_BIN2sink(file(key), sink))
+		{
+			//removed from outside, the index forgets it
+			_total -= it->second.size;
+			_entries.erase(it);
+			save();
+			return false;
+		}
+		it->second.lastUse = ++_clock;
+		save();
+		return true;
+	}
+	//__________________________________________________________________________
+	void store(const std::string & key, const HistogramSink & sink)
+	{
+		if (!enabled())
+			return;
+		std::lock_guard<std::mutex> lock(mutex());
+		read();
+		supp_sink2BIN(sink, file(key));
+		Entry & e	= _entries[key];
+		_total		-= e.size;
+		e.size		= 3 * sizeof(int) +
+					  (long long)sink.windows() * sink.cuboids() * sink.bins() * sizeof(float);
+		e.lastUse	= ++_clock;
+		_total		+= e.size;
+		evict();
+		save();
+	}
+
+private:
+	struct Entry
+	{
+		long long	size,
+					lastUse;
+		Entry() : size(0), lastUse(0){}
+	};
+	std::string						_dir;
+	long long						_maxBytes;
+	int								_maxEntries;
+	long long						_clock,
+									_total;
+	std::map<std::string, Entry>	_entries;
+
+	static std::mutex & mutex()
+	{
+		static std::mutex	mtx;
+		return mtx;
+	}
+	std::string file(const std::string & key) const
+	{
+		return _dir + "/" + key + ".bin";
+	}
+	//the entries stored or evicted by other instances since the last change
+	void read()
+	{
+		_clock = _total = 0;
+		_entries.clear();
+		std::ifstream	in(_dir + "/index.txt");
+		std::string		key;
+		Entry			e;
+		while (in >> key >> e.size >> e.lastUse)
+		{
+			_entries[key]	= e;
+			_total			+= e.size;
+			_clock			= std::max(_clock, e.lastUse);
+		}
+	}
+	//the entry just used is always kept, even alone over the limit
+	void evict()
+	{
+		while (_entries.size() > 1 &&
+			   ((_maxBytes && _total > _maxBytes) ||
+				(_maxEntries && (int)_entries.size() > _maxEntries)))
+		{
+			auto oldest = _entries.begin();
+			for (auto it = _entries.begin(); it != _entries.end(); ++it)
+				if (it->second.lastUse < oldest->second.lastUse)
+					oldest = it;
+			std::remove(file(oldest->first).c_str());
+			_total -= oldest->second.size;
+			_entries.erase(oldest);
+		}
+	}
+	void save() const
+	{
+		std::ofstream out(_dir + "/index.txt");
+		for (auto & item : _entries)
+			out << item.first << " " << item.second.size << " " << item.second.lastUse << "\n";
+	}
+};
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////